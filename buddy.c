@@ -0,0 +1,185 @@
+#include "buddy.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// number of blocks of the given order that fit in the managed frames
+static unsigned int blocks_at(const struct buddy_allocator* buddy, unsigned int order){
+    return buddy->num_frames >> order;
+}
+
+static bool bitmap_init(struct buddy_bitmap* map, unsigned int bits){
+    map->levels = 0;
+    do {
+        unsigned int words = (bits + 63) / 64;
+        map->level[map->levels] = calloc(words, sizeof(uint64_t));
+        if (map->level[map->levels] == NULL){
+            return false;
+        }
+        ++map->levels;
+        bits = words;
+    } while (bits > 1);
+    return true;
+}
+
+static void bitmap_destroy(struct buddy_bitmap* map){
+    for (unsigned int l = 0; l < map->levels; ++l) {
+        free(map->level[l]);
+    }
+    map->levels = 0;
+}
+
+static bool bitmap_test(const struct buddy_bitmap* map, unsigned int i){
+    return (map->level[0][i / 64] >> (i % 64)) & 1;
+}
+
+// set bit i, marking the summary bits of any word that goes from empty to non-empty
+static void bitmap_set(struct buddy_bitmap* map, unsigned int i){
+    for (unsigned int l = 0; l < map->levels; ++l) {
+        uint64_t* word = &map->level[l][i / 64];
+        bool was_empty = (*word == 0);
+        *word |= (uint64_t)1 << (i % 64);
+        if (!was_empty){
+            return;
+        }
+        i /= 64;
+    }
+}
+
+// clear bit i, clearing the summary bits of any word that becomes empty
+static void bitmap_clear(struct buddy_bitmap* map, unsigned int i){
+    for (unsigned int l = 0; l < map->levels; ++l) {
+        uint64_t* word = &map->level[l][i / 64];
+        *word &= ~((uint64_t)1 << (i % 64));
+        if (*word != 0){
+            return;
+        }
+        i /= 64;
+    }
+}
+
+// lowest set bit, found by following the summary words down from the top level
+static int bitmap_first(const struct buddy_bitmap* map){
+    unsigned int i = 0;
+    for (int l = (int) map->levels - 1; l >= 0; --l) {
+        uint64_t word = map->level[l][i];
+        if (word == 0){
+            return -1;
+        }
+        i = i * 64 + __builtin_ctzll(word);
+    }
+    return (int) i;
+}
+
+static void mark_free(struct buddy_allocator* buddy, unsigned int block, unsigned int order){
+    bitmap_set(&buddy->free_map[order], block);
+    ++buddy->free_blocks[order];
+    buddy->free_frames += 1u << order;
+}
+
+static void mark_used(struct buddy_allocator* buddy, unsigned int block, unsigned int order){
+    bitmap_clear(&buddy->free_map[order], block);
+    --buddy->free_blocks[order];
+    buddy->free_frames -= 1u << order;
+}
+
+bool buddy_init(struct buddy_allocator* buddy, unsigned int num_frames){
+    *buddy = (struct buddy_allocator){ .num_frames = num_frames };
+    if (num_frames == 0){
+        return false;
+    }
+    while (buddy->max_order < BUDDY_MAX_ORDER && (2u << buddy->max_order) <= num_frames){
+        ++buddy->max_order;
+    }
+    for (unsigned int o = 0; o <= buddy->max_order; ++o) {
+        if (!bitmap_init(&buddy->free_map[o], blocks_at(buddy, o))){
+            buddy_destroy(buddy);
+            return false;
+        }
+    }
+    // hand out the frames as the largest aligned blocks that fit
+    for (unsigned int frame = 0; frame < num_frames;) {
+        unsigned int order = buddy->max_order;
+        while (order > 0 && ((frame & ((1u << order) - 1)) != 0 || frame + (1u << order) > num_frames)){
+            --order;
+        }
+        mark_free(buddy, frame >> order, order);
+        frame += 1u << order;
+    }
+    return true;
+}
+
+void buddy_destroy(struct buddy_allocator* buddy){
+    for (unsigned int o = 0; o <= BUDDY_MAX_ORDER; ++o) {
+        bitmap_destroy(&buddy->free_map[o]);
+    }
+}
+
+int buddy_alloc(struct buddy_allocator* buddy, unsigned int order){
+    ++buddy->alloc_requests;
+    unsigned int o = order;
+    while (o <= buddy->max_order && buddy->free_blocks[o] == 0){
+        ++o;
+    }
+    if (o > buddy->max_order){
+        ++buddy->alloc_failures;
+        if (order <= BUDDY_MAX_ORDER && buddy->free_frames >= (1u << order)){
+            ++buddy->fragmentation_failures;
+        }
+        return -1;
+    }
+    unsigned int block = bitmap_first(&buddy->free_map[o]);
+    mark_used(buddy, block, o);
+    // split down to the requested order, keeping the lower half and freeing the upper one each time
+    while (o > order){
+        --o;
+        block *= 2;
+        mark_free(buddy, block + 1, o);
+    }
+    return (int) (block << order);
+}
+
+void buddy_free(struct buddy_allocator* buddy, unsigned int frame, unsigned int order){
+    unsigned int block = frame >> order;
+    while (order < buddy->max_order){
+        unsigned int sibling = block ^ 1;
+        if (sibling >= blocks_at(buddy, order) || !bitmap_test(&buddy->free_map[order], sibling)){
+            break;
+        }
+        mark_used(buddy, sibling, order);
+        block >>= 1;
+        ++order;
+    }
+    mark_free(buddy, block, order);
+}
+
+bool buddy_reserve(struct buddy_allocator* buddy, unsigned int frame){
+    if (frame >= buddy->num_frames){
+        return false;
+    }
+    // find the free block that contains the frame, if any
+    unsigned int order = 0;
+    while (order <= buddy->max_order
+           && ((frame >> order) >= blocks_at(buddy, order) || !bitmap_test(&buddy->free_map[order], frame >> order))){
+        ++order;
+    }
+    if (order > buddy->max_order){
+        return false;
+    }
+    mark_used(buddy, frame >> order, order);
+    // split it, giving back every half that does not contain the frame
+    while (order > 0){
+        --order;
+        mark_free(buddy, (frame >> order) ^ 1, order);
+    }
+    return true;
+}
+
+int buddy_largest_free_order(const struct buddy_allocator* buddy){
+    for (int o = (int) buddy->max_order; o >= 0; --o) {
+        if (buddy->free_blocks[o] != 0){
+            return o;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,49 @@
+#ifndef CHALLENGE6_BUDDY_H
+#define CHALLENGE6_BUDDY_H
+#include <stdbool.h>
+#include <stdint.h>
+
+// Largest block order the allocator tracks. A block of order n is 2^n contiguous frames.
+#define BUDDY_MAX_ORDER 20
+// Enough summary levels for 2^32 blocks with 64 bits per word.
+#define BUDDY_BITMAP_LEVELS 6
+
+// Free list for one order stored as a bitmap: bit i of level 0 is set when block i is free, and bit i of level n+1 is
+// set when word i of level n is non-zero. Finding a free block walks one word per level.
+struct buddy_bitmap {
+    unsigned int levels;
+    uint64_t* level[BUDDY_BITMAP_LEVELS];
+};
+
+// Physical frame allocator. Frames are numbered from 0 to num_frames - 1; a frame number times the frame size gives the
+// word address of the frame in physical memory.
+struct buddy_allocator {
+    unsigned int num_frames;
+    unsigned int max_order;
+    unsigned int free_frames;
+    unsigned int free_blocks[BUDDY_MAX_ORDER + 1];
+    struct buddy_bitmap free_map[BUDDY_MAX_ORDER + 1];
+    unsigned long long alloc_requests;
+    unsigned long long alloc_failures;
+    unsigned long long fragmentation_failures; // failures while enough frames were free, just not contiguous
+};
+
+//Sets up an allocator for num_frames frames, all of them free. Returns false if the bitmaps could not be allocated.
+extern bool buddy_init(struct buddy_allocator* buddy, unsigned int num_frames);
+
+//Releases the bitmaps held by the allocator.
+extern void buddy_destroy(struct buddy_allocator* buddy);
+
+//Allocates 2^order contiguous frames aligned to their size and returns the first frame number, or -1 if no block is available.
+extern int buddy_alloc(struct buddy_allocator* buddy, unsigned int order);
+
+//Returns a block previously handed out by buddy_alloc() with the same order, merging it with its free buddies.
+extern void buddy_free(struct buddy_allocator* buddy, unsigned int frame, unsigned int order);
+
+//Marks a single frame as in use without going through buddy_alloc(), e.g. frames already holding the page table. Returns false if the frame was not free.
+extern bool buddy_reserve(struct buddy_allocator* buddy, unsigned int frame);
+
+//Returns the order of the largest free block, or -1 when no frame is free.
+extern int buddy_largest_free_order(const struct buddy_allocator* buddy);
+
+#endif // CHALLENGE6_BUDDY_H
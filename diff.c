@@ -0,0 +1,326 @@
+#include "diff.h"
+#include "kernels.h"
+#include "memsim.h"
+#include "mm.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// everything a replay needs, the reference side's memory hash kept up to date by every write
+struct replay {
+    const struct memsim_image* image;
+    unsigned int offset_bits;
+    unsigned int num_pages;
+    int* reference_memory;
+    int* candidate_memory;
+    const struct diff_backend* backend;
+    void* state;
+    uint64_t reference_hash;
+};
+
+static unsigned long long now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// only the backend keeps accessed and dirty bits, so they do not count in the page table
+static int masked(const struct replay* replay, unsigned int word, int value){
+    return word - replay->image->page_table_loc < replay->num_pages ? value & ~(PTE_ACCESSED | PTE_DIRTY) : value;
+}
+
+// hash of one word at its position, so the memory hash is a sum that a write updates in constant time
+static uint64_t mix(unsigned int word, int value){
+    uint64_t x = (uint64_t) word << 32 | (uint32_t) value;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t memory_hash(const struct replay* replay, const int* memory){
+    uint64_t hash = 0;
+    for (unsigned int i = 0; i < replay->image->words_physical; ++i) {
+        hash += mix(i, masked(replay, i, memory[i]));
+    }
+    return hash;
+}
+
+static void reference_step(struct replay* replay, const struct trace_command* command, struct diff_output* output){
+    const struct memsim_image* image = replay->image;
+    int* memory = replay->reference_memory;
+    unsigned int virtual_address = (unsigned int) command->args[0];
+    int entry = virtual_address < image->words_virtual
+                ? memory[image->page_table_loc + (virtual_address >> replay->offset_bits)] : 0;
+    unsigned int required = PTE_PRESENT | PTE_USER | (command->op == 'w' ? PTE_WRITABLE : 0);
+    // a frame that does not fit in physical memory faults, as it does in translate_address()
+    output->fault = ((unsigned int) entry & required) != required
+                    || PTE_FRAME(entry) > image->words_physical - (1u << replay->offset_bits);
+    if (output->fault){
+        return;
+    }
+    unsigned int p_addr = get_physical_address(virtual_address, replay->offset_bits, image->page_table_loc, memory);
+    output->physical_address = p_addr;
+    if (command->op == 'r'){
+        output->value = masked(replay, p_addr, read_value(p_addr, replay->offset_bits, image->page_table_loc, memory));
+    }else if (command->op == 'w'){
+        replay->reference_hash -= mix(p_addr, masked(replay, p_addr, memory[p_addr]));
+        write_value(command->args[1], p_addr, replay->offset_bits, image->page_table_loc, memory);
+        replay->reference_hash += mix(p_addr, masked(replay, p_addr, memory[p_addr]));
+        output->value = command->args[1];
+    }
+}
+
+static void candidate_step(struct replay* replay, const struct trace_command* command, struct diff_output* output){
+    const struct memsim_image* image = replay->image;
+    int* memory = replay->candidate_memory;
+    unsigned int p_addr;
+    output->fault = !replay->backend->translate(replay->state, (unsigned int) command->args[0], command->op == 'w',
+                                                &p_addr);
+    if (output->fault){
+        return;
+    }
+    output->physical_address = p_addr;
+    if (p_addr >= image->words_physical){
+        // out of physical memory, which the comparison catches without touching memory
+        return;
+    }
+    if (command->op == 'r'){
+        output->value = masked(replay, p_addr, read_value(p_addr, replay->offset_bits, image->page_table_loc, memory));
+    }else if (command->op == 'w'){
+        write_value(command->args[1], p_addr, replay->offset_bits, image->page_table_loc, memory);
+        output->value = command->args[1];
+    }
+}
+
+static bool same_output(const struct diff_output* a, const struct diff_output* b){
+    return a->fault == b->fault && (a->fault || (a->physical_address == b->physical_address && a->value == b->value));
+}
+
+static void remember(struct diff_report* report, const struct diff_output* output){
+    if (report->context_count == DIFF_CONTEXT){
+        memmove(report->context, report->context + 1, (DIFF_CONTEXT - 1) * sizeof(struct diff_output));
+        --report->context_count;
+    }
+    report->context[report->context_count++] = *output;
+}
+
+// compare the backend's memory with the reference, finding the first word that differs when they do not match
+static bool check_memory(struct replay* replay, struct diff_report* report){
+    ++report->full_checks;
+    if (memory_hash(replay, replay->candidate_memory) == replay->reference_hash){
+        return true;
+    }
+    for (unsigned int i = 0; i < replay->image->words_physical; ++i) {
+        int reference = masked(replay, i, replay->reference_memory[i]);
+        int candidate = masked(replay, i, replay->candidate_memory[i]);
+        if (reference != candidate){
+            report->word = i;
+            report->reference_word = reference;
+            report->candidate_word = candidate;
+            break;
+        }
+    }
+    report->result = DIFF_MEMORY;
+    return false;
+}
+
+// run both paths over one chunk of commands and compare what they gave
+static bool replay_chunk(struct replay* replay, const struct trace_command* commands, const size_t* indices,
+                         size_t length, struct diff_output* reference, struct diff_output* candidate,
+                         struct diff_report* report){
+    unsigned long long start = now_ns();
+    for (size_t i = 0; i < length; ++i) {
+        reference[i] = (struct diff_output){ .command = indices[i] };
+        reference_step(replay, &commands[indices[i]], &reference[i]);
+    }
+    unsigned long long middle = now_ns();
+    for (size_t i = 0; i < length; ++i) {
+        candidate[i] = (struct diff_output){ .command = indices[i] };
+        candidate_step(replay, &commands[indices[i]], &candidate[i]);
+    }
+    report->reference_ns += middle - start;
+    report->candidate_ns += now_ns() - middle;
+    for (size_t i = 0; i < length; ++i) {
+        if (!same_output(&reference[i], &candidate[i])){
+            const struct memsim_image* image = replay->image;
+            unsigned int page = (unsigned int) commands[indices[i]].args[0] >> replay->offset_bits;
+            report->result = DIFF_OUTPUT;
+            report->reference = reference[i];
+            report->candidate = candidate[i];
+            if (page < replay->num_pages){
+                report->reference_entry = replay->reference_memory[image->page_table_loc + page];
+                report->candidate_entry = replay->candidate_memory[image->page_table_loc + page];
+            }
+            return false;
+        }
+        report->output_digest = report->output_digest * 0x100000001b3ull
+                                + (reference[i].fault ? 1 : mix(reference[i].physical_address, reference[i].value));
+        ++report->operations;
+        remember(report, &reference[i]);
+    }
+    return true;
+}
+
+bool diff_replay(const struct memsim_image* image,
+                 const struct diff_backend* backend,
+                 const struct trace_command* commands,
+                 size_t count,
+                 size_t chunk,
+                 size_t check_interval,
+                 struct diff_report* report){
+    *report = (struct diff_report){ .result = DIFF_FAILED };
+    struct replay replay = {
+        .image = image,
+        .offset_bits = __builtin_ctz(image->frame_words),
+        .num_pages = image->words_virtual / image->frame_words,
+        .backend = backend,
+    };
+    size_t bytes = image->words_physical * sizeof(int);
+    chunk = chunk == 0 ? 1 : chunk;
+    replay.reference_memory = malloc(bytes);
+    replay.candidate_memory = malloc(bytes);
+    size_t* indices = malloc(chunk * sizeof(size_t));
+    struct diff_output* outputs = malloc(2 * chunk * sizeof(struct diff_output));
+    bool ready = replay.reference_memory != NULL && replay.candidate_memory != NULL && indices != NULL
+                 && outputs != NULL;
+    if (ready){
+        memcpy(replay.reference_memory, image->physical_memory, bytes);
+        memcpy(replay.candidate_memory, image->physical_memory, bytes);
+        ready = backend->init(&replay.state, image, replay.candidate_memory);
+    }
+    if (ready){
+        report->result = DIFF_SAME;
+        replay.reference_hash = memory_hash(&replay, replay.reference_memory);
+        size_t next = 0, unchecked = 0;
+        while (report->result == DIFF_SAME && next < count){
+            // the next chunk of commands both paths can run
+            size_t length = 0;
+            for (; next < count && length < chunk; ++next) {
+                char op = commands[next].op;
+                if (op == 't' || op == 'r' || op == 'w'){
+                    indices[length++] = next;
+                }else{
+                    ++report->skipped;
+                }
+            }
+            if (!replay_chunk(&replay, commands, indices, length, outputs, outputs + chunk, report)){
+                break;
+            }
+            unchecked += length;
+            if (unchecked >= check_interval || next == count){
+                if (!check_memory(&replay, report)){
+                    break;
+                }
+                report->equal_through = next;
+                unchecked = 0;
+            }
+        }
+        report->memory_hash = replay.reference_hash;
+        backend->destroy(replay.state);
+    }
+    free(outputs);
+    free(indices);
+    free(replay.candidate_memory);
+    free(replay.reference_memory);
+    return report->result == DIFF_SAME;
+}
+
+// translate_address() straight over the page table
+struct translate_state {
+    int* memory;
+    unsigned int offset_bits;
+    unsigned int page_table_loc;
+    unsigned int words_virtual;
+    unsigned int words_physical;
+};
+
+static bool translate_init(void** state, const struct memsim_image* image, int* memory){
+    struct translate_state* translate = malloc(sizeof(struct translate_state));
+    if (translate == NULL){
+        return false;
+    }
+    *translate = (struct translate_state){ memory, __builtin_ctz(image->frame_words), image->page_table_loc,
+                                           image->words_virtual, image->words_physical };
+    *state = translate;
+    return true;
+}
+
+static bool translate_translate(void* state, unsigned int virtual_address, bool write,
+                                unsigned int* physical_address){
+    const struct translate_state* translate = state;
+    return virtual_address < translate->words_virtual
+           && translate_address(virtual_address, translate->offset_bits, translate->page_table_loc, translate->memory,
+                                translate->words_physical, write ? PTE_WRITABLE : 0, physical_address);
+}
+
+// the translation compiled for the image's page size
+struct kernel_state {
+    int* memory;
+    const struct translation_kernel* kernel;
+    unsigned int offset_bits;
+    unsigned int page_table_loc;
+    unsigned int words_virtual;
+    unsigned int words_physical;
+};
+
+static bool kernel_init(void** state, const struct memsim_image* image, int* memory){
+    struct kernel_state* kernel = malloc(sizeof(struct kernel_state));
+    if (kernel == NULL){
+        return false;
+    }
+    *kernel = (struct kernel_state){ memory, kernel_for_frame_words(image->frame_words),
+                                     __builtin_ctz(image->frame_words), image->page_table_loc, image->words_virtual,
+                                     image->words_physical };
+    *state = kernel;
+    return true;
+}
+
+static bool kernel_translate(void* state, unsigned int virtual_address, bool write, unsigned int* physical_address){
+    const struct kernel_state* kernel = state;
+    return virtual_address < kernel->words_virtual
+           && kernel->kernel->translate(virtual_address, kernel->offset_bits, kernel->page_table_loc, kernel->memory,
+                                        kernel->words_physical, write ? PTE_WRITABLE : 0, physical_address);
+}
+
+// the whole access path, areas, frame allocation and translation cache model included. It gives pages the
+// reference path faults on a frame, so it only agrees on traces that stay on present pages.
+static bool mm_backend_init(void** state, const struct memsim_image* image, int* memory){
+    struct address_space* mm = malloc(sizeof(struct address_space));
+    if (mm == NULL || !mm_init(mm, memory, image->words_virtual, image->words_physical, image->frame_words,
+                               image->page_table_loc)){
+        free(mm);
+        return false;
+    }
+    *state = mm;
+    return true;
+}
+
+static void mm_backend_destroy(void* state){
+    mm_destroy(state);
+    free(state);
+}
+
+static bool mm_backend_translate(void* state, unsigned int virtual_address, bool write,
+                                 unsigned int* physical_address){
+    return MM_SUCCEEDED(mm_access(state, virtual_address, write ? VMA_WRITE : VMA_READ, physical_address));
+}
+
+static const struct diff_backend BACKENDS[] = {
+    { "translate", translate_init, free, translate_translate },
+    { "kernel", kernel_init, free, kernel_translate },
+    { "mm", mm_backend_init, mm_backend_destroy, mm_backend_translate },
+};
+
+const struct diff_backend* diff_backend_from_name(const char* name){
+    for (size_t i = 0; i < sizeof(BACKENDS) / sizeof(BACKENDS[0]); ++i) {
+        if (strcmp(name, BACKENDS[i].name) == 0){
+            return &BACKENDS[i];
+        }
+    }
+    return NULL;
+}
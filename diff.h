@@ -0,0 +1,69 @@
+#ifndef CHALLENGE6_DIFF_H
+#define CHALLENGE6_DIFF_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "parse.h"
+
+// Outputs both paths agreed on that a report keeps from before a divergence.
+#define DIFF_CONTEXT 8
+
+// A translation path under test. It gets its own copy of physical memory, with the page table in the PTE format, and
+// only has to translate: the harness does the reads and writes on the physical addresses it returns.
+struct diff_backend {
+    const char* name;
+    bool (*init)(void** state, const struct memsim_image* image, int* memory);
+    void (*destroy)(void* state);
+    // false when the access faults
+    bool (*translate)(void* state, unsigned int virtual_address, bool write, unsigned int* physical_address);
+};
+
+enum diff_result {
+    DIFF_SAME,
+    DIFF_OUTPUT, // an access faulted on one side only, or gave a different address or value
+    DIFF_MEMORY, // every output agreed but the memories did not
+    DIFF_FAILED  // memory for the replay could not be allocated
+};
+
+// What one t, r or w command gave.
+struct diff_output {
+    size_t command; // index in the trace
+    bool fault;
+    unsigned int physical_address;
+    int value;      // the value read or written
+};
+
+struct diff_report {
+    enum diff_result result;
+    size_t operations;          // t, r and w commands replayed
+    size_t skipped;             // other commands, which the reference path has no equivalent for
+    size_t full_checks;
+    uint64_t output_digest;     // rolling hash of every output, the same for every path that agrees
+    uint64_t memory_hash;       // of the reference memory at the end
+    unsigned long long reference_ns;
+    unsigned long long candidate_ns;
+    struct diff_output reference;            // the first outputs that differ
+    struct diff_output candidate;
+    int reference_entry;                     // page table entry of the address involved on each side
+    int candidate_entry;
+    struct diff_output context[DIFF_CONTEXT]; // the outputs before them, oldest first
+    unsigned int context_count;
+    size_t equal_through;       // commands before this index left both memories the same
+    unsigned int word;          // first word that differs, for DIFF_MEMORY
+    int reference_word;
+    int candidate_word;
+};
+
+//Replays the t, r and w commands of a trace through the reference path (get_physical_address(), read_value() and write_value() on entries that allow the access and whose frame fits in physical memory) and through backend, each on its own copy of the image, which must already have its page table in the PTE format. The paths take turns running chunk commands, and every output is compared. Memory is compared through a hash of the reference memory kept up to date write by write against a full hash of the backend's memory every check_interval operations and at the end. The accessed and dirty bits of page table entries are left out of every comparison, since only the backend keeps them. Stops at the first divergence. Returns true when the paths agreed throughout, with the details in report either way.
+extern bool diff_replay(const struct memsim_image* image,
+                        const struct diff_backend* backend,
+                        const struct trace_command* commands,
+                        size_t count,
+                        size_t chunk,
+                        size_t check_interval,
+                        struct diff_report* report);
+
+//Looks a backend up by name (translate, kernel, mm). Returns NULL for an unknown name.
+extern const struct diff_backend* diff_backend_from_name(const char* name);
+
+#endif // CHALLENGE6_DIFF_H
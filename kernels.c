@@ -0,0 +1,146 @@
+#include "kernels.h"
+#include "memsim.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// One kernel pair. SHIFT is either a constant, for the specialized kernels, or the offset_bits argument, for the
+// generic one, so every kernel is the same code and only the constants differ.
+#define DEFINE_KERNEL(NAME, SHIFT)                                                                                    \
+    static inline bool translate_##NAME(unsigned int virtual_address,                                                 \
+                                        unsigned int offset_bits,                                                     \
+                                        unsigned int page_table_loc,                                                  \
+                                        int* physical_memory,                                                         \
+                                        unsigned int words_physical,                                                  \
+                                        unsigned int access,                                                          \
+                                        unsigned int* physical_address){                                              \
+        (void) offset_bits;                                                                                           \
+        int* entry = &physical_memory[(virtual_address >> (SHIFT)) + page_table_loc];                                 \
+        unsigned int required = PTE_PRESENT | PTE_USER | access,                                                      \
+                     /* a frame running past physical memory is as good as not present */                             \
+                     allowed = ((*entry & required) == required)                                                      \
+                               & (PTE_FRAME(*entry) <= words_physical - (1u << (SHIFT)));                             \
+        /* accessed for every access, dirty for writes (PTE_WRITABLE << 3 == PTE_DIRTY), nothing when not allowed */  \
+        *entry |= (int) ((PTE_ACCESSED | (access << 3)) & -allowed);                                                  \
+        if (allowed){                                                                                                 \
+            *physical_address = PTE_FRAME(*entry) + (virtual_address & ((1u << (SHIFT)) - 1));                        \
+        }                                                                                                             \
+        return allowed;                                                                                               \
+    }                                                                                                                 \
+    static void replay_##NAME(const struct trace_command* commands,                                                   \
+                              size_t count,                                                                           \
+                              unsigned int words_virtual,                                                             \
+                              unsigned int words_physical,                                                            \
+                              unsigned int offset_bits,                                                               \
+                              unsigned int page_table_loc,                                                            \
+                              int* physical_memory,                                                                   \
+                              struct kernel_replay* result){                                                          \
+        (void) offset_bits;                                                                                           \
+        for (size_t i = 0; i < count; ++i) {                                                                          \
+            char op = commands[i].op;                                                                                 \
+            unsigned int virtual_address = (unsigned int) commands[i].args[0], p_addr;                                \
+            if (op != 't' && op != 'r' && op != 'w'){                                                                 \
+                continue;                                                                                             \
+            }                                                                                                         \
+            ++result->operations;                                                                                     \
+            if (virtual_address >= words_virtual                                                                      \
+                || !translate_##NAME(virtual_address, offset_bits, page_table_loc, physical_memory, words_physical,   \
+                                     op == 'w' ? PTE_WRITABLE : 0, &p_addr)){                                         \
+                ++result->faults;                                                                                     \
+            }else if (op == 't'){                                                                                     \
+                result->checksum += p_addr;                                                                           \
+            }else if (op == 'r'){                                                                                     \
+                result->checksum += physical_memory[p_addr];                                                          \
+            }else{                                                                                                    \
+                physical_memory[p_addr] = commands[i].args[1];                                                        \
+            }                                                                                                         \
+        }                                                                                                             \
+    }
+
+DEFINE_KERNEL(generic, offset_bits)
+DEFINE_KERNEL(2, 2)
+DEFINE_KERNEL(3, 3)
+DEFINE_KERNEL(4, 4)
+DEFINE_KERNEL(5, 5)
+DEFINE_KERNEL(6, 6)
+DEFINE_KERNEL(7, 7)
+DEFINE_KERNEL(8, 8)
+DEFINE_KERNEL(9, 9)
+DEFINE_KERNEL(10, 10)
+DEFINE_KERNEL(11, 11)
+DEFINE_KERNEL(12, 12)
+
+#define KERNEL(BITS) { BITS, translate_##BITS, replay_##BITS }
+
+static const struct translation_kernel GENERIC = { 0, translate_generic, replay_generic };
+static const struct translation_kernel KERNELS[KERNEL_MAX_OFFSET_BITS - KERNEL_MIN_OFFSET_BITS + 1] = {
+    KERNEL(2), KERNEL(3), KERNEL(4), KERNEL(5), KERNEL(6), KERNEL(7), KERNEL(8), KERNEL(9), KERNEL(10), KERNEL(11),
+    KERNEL(12),
+};
+
+const struct translation_kernel* kernel_for_frame_words(unsigned int frame_words){
+    unsigned int offset_bits = __builtin_ctz(frame_words);
+    if (offset_bits < KERNEL_MIN_OFFSET_BITS || offset_bits > KERNEL_MAX_OFFSET_BITS){
+        return &GENERIC;
+    }
+    return &KERNELS[offset_bits - KERNEL_MIN_OFFSET_BITS];
+}
+
+const struct translation_kernel* kernel_generic(void){
+    return &GENERIC;
+}
+
+static unsigned long long now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// replay the trace once on a fresh copy of the image. Returns the time it took.
+static unsigned long long time_replay(const struct translation_kernel* kernel, const struct memsim_image* image,
+                                      const struct trace_command* commands, size_t count, int* memory,
+                                      struct kernel_replay* result){
+    memcpy(memory, image->physical_memory, image->words_physical * sizeof(int));
+    *result = (struct kernel_replay){ .operations = 0 };
+    unsigned long long start = now_ns();
+    kernel->replay(commands, count, image->words_virtual, image->words_physical, __builtin_ctz(image->frame_words),
+                   image->page_table_loc, memory, result);
+    return now_ns() - start;
+}
+
+bool kernel_benchmark(const struct memsim_image* image,
+                      const struct trace_command* commands,
+                      size_t count,
+                      unsigned int repetitions,
+                      struct kernel_benchmark* benchmark){
+    size_t bytes = image->words_physical * sizeof(int);
+    int* generic_memory = malloc(bytes);
+    int* specialized_memory = malloc(bytes);
+    if (generic_memory == NULL || specialized_memory == NULL){
+        free(generic_memory);
+        free(specialized_memory);
+        return false;
+    }
+    *benchmark = (struct kernel_benchmark){ .specialized = kernel_for_frame_words(image->frame_words), .same = true };
+    unsigned long long generic_best = ~0ull, specialized_best = ~0ull;
+    // the two take turns so that both see the same machine
+    for (unsigned int r = 0; r < repetitions; ++r) {
+        struct kernel_replay generic, specialized;
+        unsigned long long ns = time_replay(&GENERIC, image, commands, count, generic_memory, &generic);
+        generic_best = ns < generic_best ? ns : generic_best;
+        ns = time_replay(benchmark->specialized, image, commands, count, specialized_memory, &specialized);
+        specialized_best = ns < specialized_best ? ns : specialized_best;
+        benchmark->operations = generic.operations;
+        benchmark->same &= generic.operations == specialized.operations && generic.faults == specialized.faults
+                           && generic.checksum == specialized.checksum
+                           && memcmp(generic_memory, specialized_memory, bytes) == 0;
+    }
+    if (benchmark->operations != 0){
+        benchmark->generic_ns = (double) generic_best / benchmark->operations;
+        benchmark->specialized_ns = (double) specialized_best / benchmark->operations;
+    }
+    free(generic_memory);
+    free(specialized_memory);
+    return true;
+}
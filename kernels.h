@@ -0,0 +1,63 @@
+#ifndef CHALLENGE6_KERNELS_H
+#define CHALLENGE6_KERNELS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "parse.h"
+
+// Page sizes, as offset bits, with kernels compiled for them. Other sizes get the generic kernel.
+#define KERNEL_MIN_OFFSET_BITS 2
+#define KERNEL_MAX_OFFSET_BITS 12
+
+// What a replay kernel gave for a trace.
+struct kernel_replay {
+    unsigned long long operations; // t, r and w commands run, the others are skipped
+    unsigned long long faults;
+    long long checksum;            // of the addresses translated and the values read
+};
+
+// Translation and replay over the single-level page table for one page size, with the shift and mask compiled in.
+// translate() is what translate_address() runs, through the generic kernel, and takes the same arguments; the
+// specialized kernels ignore offset_bits. replay() runs the t, r and w commands of a trace through translate() and
+// reads and writes memory the way the simulator does, without printing.
+struct translation_kernel {
+    unsigned int offset_bits; // 0 for the generic kernel
+    bool (*translate)(unsigned int virtual_address,
+                      unsigned int offset_bits,
+                      unsigned int page_table_loc,
+                      int* physical_memory,
+                      unsigned int words_physical,
+                      unsigned int access,
+                      unsigned int* physical_address);
+    void (*replay)(const struct trace_command* commands,
+                   size_t count,
+                   unsigned int words_virtual,
+                   unsigned int words_physical,
+                   unsigned int offset_bits,
+                   unsigned int page_table_loc,
+                   int* physical_memory,
+                   struct kernel_replay* result);
+};
+
+// Best time per operation of each kernel over the repetitions of a benchmark.
+struct kernel_benchmark {
+    const struct translation_kernel* specialized;
+    unsigned long long operations;
+    double generic_ns;
+    double specialized_ns;
+    bool same; // both kernels gave the same results and left the same memory
+};
+
+//Returns the kernel for pages of frame_words words, a power of two: the one compiled for its offset bits when there is one, the generic kernel otherwise.
+extern const struct translation_kernel* kernel_for_frame_words(unsigned int frame_words);
+
+//Returns the kernel that takes the offset bits at run time.
+extern const struct translation_kernel* kernel_generic(void);
+
+//Times the replay of a trace through the generic kernel and through the one for the image's page size, repetitions times each, every run on a fresh copy of the image, which must have its page table in the PTE format. Returns false if memory could not be allocated.
+extern bool kernel_benchmark(const struct memsim_image* image,
+                             const struct trace_command* commands,
+                             size_t count,
+                             unsigned int repetitions,
+                             struct kernel_benchmark* benchmark);
+
+#endif // CHALLENGE6_KERNELS_H
@@ -0,0 +1,185 @@
+#include "ksm.h"
+#include "memsim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned long long now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// hash of a frame's words. The lanes do not depend on each other, so the loop is vectorized; the tail of frames
+// smaller than the lane count goes into the first lanes.
+static uint32_t hash_frame(const int* words, unsigned int count){
+    uint32_t lanes[KSM_HASH_LANES];
+    for (unsigned int j = 0; j < KSM_HASH_LANES; ++j) {
+        lanes[j] = 0x811c9dc5u + j;
+    }
+    unsigned int i = 0;
+    for (; i + KSM_HASH_LANES <= count; i += KSM_HASH_LANES) {
+        for (unsigned int j = 0; j < KSM_HASH_LANES; ++j) {
+            lanes[j] = (lanes[j] ^ (uint32_t) words[i + j]) * 0x9e3779b1u;
+        }
+    }
+    for (unsigned int j = 0; i < count; ++i, ++j) {
+        lanes[j] = (lanes[j] ^ (uint32_t) words[i]) * 0x9e3779b1u;
+    }
+    uint32_t hash = count;
+    for (unsigned int j = 0; j < KSM_HASH_LANES; ++j) {
+        hash = (hash ^ lanes[j]) * 0x85ebca6bu;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+static bool same_frame(const struct ksm* ksm, unsigned int base, unsigned int other){
+    const int* memory = ksm->mm->physical_memory;
+    return memcmp(&memory[base], &memory[other], ksm->mm->frame_words * sizeof(int)) == 0;
+}
+
+// a page can be merged when it is present, not shared yet and the only user of an aligned frame
+static bool mergeable(const struct ksm* ksm, unsigned int page){
+    const struct address_space* mm = ksm->mm;
+    int entry = mm->physical_memory[mm->page_table_loc + page];
+    unsigned int base = PTE_FRAME(entry);
+    return (entry & (PTE_PRESENT | PTE_SHARED)) == PTE_PRESENT && (base & (mm->frame_words - 1)) == 0
+           && mm->frame_refs[base / mm->frame_words] == 1;
+}
+
+static unsigned int base_of(const struct ksm* ksm, unsigned int page){
+    return PTE_FRAME(ksm->mm->physical_memory[ksm->mm->page_table_loc + page]);
+}
+
+// turn the frame of page into a shared one, pinned so it stays while pages stop and start using it
+static bool add_stable(struct ksm* ksm, unsigned int page, uint32_t hash){
+    struct ksm_stable* node = malloc(sizeof(struct ksm_stable));
+    if (node == NULL){
+        return false;
+    }
+    struct ksm_stable** bucket = &ksm->stable[hash & (ksm->buckets - 1)];
+    *node = (struct ksm_stable){ .hash = hash, .base = base_of(ksm, page), .next = *bucket };
+    *bucket = node;
+    ++ksm->stable_frames;
+    mm_pin_frame(ksm->mm, node->base / ksm->mm->frame_words);
+    mm_share_page(ksm->mm, page, node->base);
+    return true;
+}
+
+static void scan_page(struct ksm* ksm, unsigned int page){
+    ++ksm->pages_scanned;
+    if (!mergeable(ksm, page)){
+        return;
+    }
+    unsigned int base = base_of(ksm, page);
+    uint32_t hash = hash_frame(&ksm->mm->physical_memory[base], ksm->mm->frame_words);
+    for (struct ksm_stable* node = ksm->stable[hash & (ksm->buckets - 1)]; node != NULL; node = node->next) {
+        if (node->hash == hash && same_frame(ksm, node->base, base)){
+            mm_share_page(ksm->mm, page, node->base);
+            ++ksm->merges;
+            return;
+        }
+    }
+    // a page that changed since the last pass is likely to change again, leave it alone until it settles
+    if (ksm->checksums[page] != hash){
+        ksm->checksums[page] = hash;
+        return;
+    }
+    unsigned int* bucket = &ksm->unstable[hash & (ksm->buckets - 1)];
+    for (unsigned int i = *bucket; i != 0; i = ksm->items[i - 1].next) {
+        struct ksm_item* item = &ksm->items[i - 1];
+        // the other page may have been written, unmapped or merged since it was put here
+        if (item->hash == hash && mergeable(ksm, item->page) && same_frame(ksm, base_of(ksm, item->page), base)){
+            if (add_stable(ksm, item->page, hash)){
+                mm_share_page(ksm->mm, page, base_of(ksm, item->page));
+                ++ksm->merges;
+            }
+            return;
+        }
+    }
+    ksm->items[ksm->item_count] = (struct ksm_item){ .page = page, .hash = hash, .next = *bucket };
+    *bucket = ++ksm->item_count;
+}
+
+// let go of shared frames no page maps any more; the pin is the last reference, so they go back to the allocator
+static void prune_stable(struct ksm* ksm){
+    for (unsigned int b = 0; b < ksm->buckets; ++b) {
+        for (struct ksm_stable** link = &ksm->stable[b]; *link != NULL;) {
+            struct ksm_stable* node = *link;
+            unsigned int frame = node->base / ksm->mm->frame_words;
+            if (ksm->mm->frame_refs[frame] > 1){
+                link = &node->next;
+                continue;
+            }
+            *link = node->next;
+            mm_unpin_frame(ksm->mm, frame);
+            --ksm->stable_frames;
+            free(node);
+        }
+    }
+}
+
+bool ksm_init(struct ksm* ksm, struct address_space* mm){
+    *ksm = (struct ksm){ .mm = mm, .buckets = 1 };
+    while (ksm->buckets < mm->num_pages){
+        ksm->buckets *= 2;
+    }
+    ksm->checksums = calloc(mm->num_pages, sizeof(uint32_t));
+    ksm->stable = calloc(ksm->buckets, sizeof(struct ksm_stable*));
+    ksm->unstable = calloc(ksm->buckets, sizeof(unsigned int));
+    ksm->items = malloc(mm->num_pages * sizeof(struct ksm_item));
+    if (ksm->checksums == NULL || ksm->stable == NULL || ksm->unstable == NULL || ksm->items == NULL){
+        ksm_destroy(ksm);
+        return false;
+    }
+    return true;
+}
+
+void ksm_destroy(struct ksm* ksm){
+    for (unsigned int b = 0; ksm->stable != NULL && b < ksm->buckets; ++b) {
+        for (struct ksm_stable *node = ksm->stable[b], *next; node != NULL; node = next) {
+            next = node->next;
+            free(node);
+        }
+    }
+    free(ksm->checksums);
+    free(ksm->stable);
+    free(ksm->unstable);
+    free(ksm->items);
+    ksm->stable = NULL;
+}
+
+void ksm_scan(struct ksm* ksm, unsigned int pages){
+    unsigned long long start = now_ns();
+    for (unsigned int i = 0; i < pages; ++i) {
+        scan_page(ksm, ksm->cursor);
+        if (++ksm->cursor < ksm->mm->num_pages){
+            continue;
+        }
+        // end of a pass: the unstable pages are only trusted for one pass
+        ksm->cursor = 0;
+        ksm->item_count = 0;
+        memset(ksm->unstable, 0, ksm->buckets * sizeof(unsigned int));
+        prune_stable(ksm);
+        unsigned long long end = now_ns();
+        ksm->scan_ns += ksm->pass_ns + (end - start);
+        ksm->pass_ns = 0;
+        ++ksm->passes;
+        start = end;
+    }
+    ksm->pass_ns += now_ns() - start;
+}
+
+unsigned int ksm_pages_sharing(const struct ksm* ksm){
+    // every reference to a shared frame but the pin is a page mapping it
+    unsigned int sharing = 0;
+    for (unsigned int b = 0; b < ksm->buckets; ++b) {
+        for (const struct ksm_stable* node = ksm->stable[b]; node != NULL; node = node->next) {
+            sharing += ksm->mm->frame_refs[node->base / ksm->mm->frame_words] - 1;
+        }
+    }
+    return sharing;
+}
@@ -0,0 +1,58 @@
+#ifndef CHALLENGE6_KSM_H
+#define CHALLENGE6_KSM_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "mm.h"
+
+// Independent hash lanes over the words of a frame, so hashing a frame runs on vector registers.
+#define KSM_HASH_LANES 8
+
+// A frame several pages share. The merger holds a reference on it so it stays put while pages come and go.
+struct ksm_stable {
+    uint32_t hash;
+    unsigned int base;
+    struct ksm_stable* next;
+};
+
+// A page seen during the current pass whose contents did not change since the pass before, chained by hash.
+struct ksm_item {
+    unsigned int page;
+    uint32_t hash;
+    unsigned int next; // index + 1 of the next item in the bucket, 0 ends the chain
+};
+
+// Same-page merging over an address space. Each call scans a few pages from a cursor: a page whose frame matches a
+// shared frame is pointed at it, and a page unchanged since the last pass is matched against the other unchanged pages
+// of this pass, which become a new shared frame when two are equal. Pages keep sharing until a write copies the frame
+// back out (MM_FAULT_COW). Only pages with an aligned frame of their own take part; unaligned frames from an image can
+// overlap the page table or other pages.
+struct ksm {
+    struct address_space* mm;
+    unsigned int cursor;
+    uint32_t* checksums;          // hash of every page the last time it was scanned
+    unsigned int buckets;         // of both tables, a power of two
+    struct ksm_stable** stable;
+    unsigned int stable_frames;
+    unsigned int* unstable;       // index + 1 of the first item in each bucket, cleared after every pass
+    struct ksm_item* items;
+    unsigned int item_count;
+    unsigned long long pages_scanned;
+    unsigned long long merges;    // pages that gave up their frame
+    unsigned long long passes;
+    unsigned long long pass_ns;   // time spent in the pass that is going on
+    unsigned long long scan_ns;   // time spent in all finished passes
+};
+
+//Sets up merging over an address space. Returns false if memory could not be allocated.
+extern bool ksm_init(struct ksm* ksm, struct address_space* mm);
+
+//Releases the tables held by the merger. The shared frames stay mapped.
+extern void ksm_destroy(struct ksm* ksm);
+
+//Scans the next pages, wrapping around to the first page after the last one.
+extern void ksm_scan(struct ksm* ksm, unsigned int pages);
+
+//Number of pages mapping a shared frame, over every shared frame. Merging saves that many frames less the shared frames themselves.
+extern unsigned int ksm_pages_sharing(const struct ksm* ksm);
+
+#endif // CHALLENGE6_KSM_H
@@ -1,5 +1,6 @@
 
 #include "memsim.h"
+#include "kernels.h"
 #include <stdbool.h>
 
 //Check if a value is a power of two. One way to perform this check is to do a binary & between the value and the value minus 1. When the value is a power of two this will produce a 0 for all other values it will be non-zero.
@@ -19,11 +20,44 @@ unsigned int get_physical_address(unsigned int virtual_address,
                                   const int* physical_memory){
     unsigned int
             page_number = (virtual_address >> offset_bits),
-            frame_number = physical_memory[page_number+page_table_loc],
+            frame_number = PTE_FRAME(physical_memory[page_number+page_table_loc]),
             offset = virtual_address &((1 << offset_bits)-1);
     return (frame_number + offset);
 };
 
+//Translates a virtual address like get_physical_address(), but only when the page table entry allows the access, setting the accessed and dirty bits as it goes.
+bool translate_address(unsigned int virtual_address,
+                       unsigned int offset_bits,
+                       unsigned int page_table_loc,
+                       int* physical_memory,
+                       unsigned int words_physical,
+                       unsigned int access,
+                       unsigned int* physical_address){
+    // the kernels hold the one copy of the translation
+    return kernel_generic()->translate(virtual_address, offset_bits, page_table_loc, physical_memory, words_physical,
+                                       access, physical_address);
+}
+
+// conversion of the original page table format
+bool convert_legacy_page_table(unsigned int page_table_loc,
+                               unsigned int num_pages,
+                               unsigned int frame_words,
+                               unsigned int words_physical,
+                               int* physical_memory){
+    if (words_physical > PTE_MAX_WORDS){
+        return false;
+    }
+    for (unsigned int i = 0; i < num_pages; ++i) {
+        int* entry = &physical_memory[page_table_loc + i];
+        bool inside = (*entry >= 0 && (unsigned int) *entry <= words_physical - frame_words);
+        // a write through a page lying on the page table could store any entry, so those pages stay read only
+        bool on_table = inside && (unsigned int) *entry < page_table_loc + num_pages
+                        && (unsigned int) *entry + frame_words > page_table_loc;
+        *entry = inside ? PTE_MAKE(*entry, PTE_PRESENT | PTE_USER | (on_table ? 0 : PTE_WRITABLE)) : 0;
+    }
+    return true;
+}
+
 //Takes a virtual address and returns the value at the corresponding physical address. The virtual address, the number of bits used for the offset, the starting location of the page table(s), and a pointer to the physical memory are also passed as parameters.
 int read_value(unsigned int virtual_address,
                unsigned int page_mask,
@@ -2,6 +2,22 @@
 #define CHALLENGE6_MEMSIM_H
 #include <stdbool.h>
 
+// Page table entry layout. The low PTE_FLAG_BITS bits hold the flags and the bits above them the word address where
+// the frame starts. Frames are addressed by word rather than by number because the mem_files place frames at
+// addresses that are not multiples of the frame size.
+#define PTE_PRESENT 0x01
+#define PTE_WRITABLE 0x02
+#define PTE_USER 0x04
+#define PTE_ACCESSED 0x08
+#define PTE_DIRTY 0x10
+#define PTE_SHARED 0x20 // the frame is shared with other pages and never writable through this entry
+#define PTE_SWAPPED 0x40 // not present, the bits above the flags hold the handle of the page in the compressed tier
+#define PTE_FLAG_BITS 8
+#define PTE_FLAGS_MASK ((1u << PTE_FLAG_BITS) - 1)
+// largest physical memory, in words, whose frame addresses fit in an entry
+#define PTE_MAX_WORDS (1u << (32 - PTE_FLAG_BITS))
+#define PTE_FRAME(entry) ((unsigned int) (entry) >> PTE_FLAG_BITS)
+#define PTE_MAKE(frame, flags) ((int) (((unsigned int) (frame) << PTE_FLAG_BITS) | (flags)))
 
 //Check if a value is a power of two. One way to perform this check is to do a binary & between the value and the value minus 1. When the value is a power of two this will produce a 0 for all other values it will be non-zero.
 extern bool is_power_of_2(unsigned int value);
@@ -12,6 +28,22 @@ extern unsigned int get_physical_address(unsigned int virtual_address,
                          unsigned int page_table_loc,
                          const int* physical_memory);
 
+//Translates a virtual address like get_physical_address(), but only when the page table entry is present, user accessible and, if access is PTE_WRITABLE, writable, and its frame lies inside the words_physical words of physical memory. On success the accessed bit, and for writes the dirty bit, are set in the entry and the physical address is stored. Returns false and leaves both the entry and the physical address untouched otherwise. Pass 0 as access for reads.
+extern bool translate_address(unsigned int virtual_address,
+                              unsigned int offset_bits,
+                              unsigned int page_table_loc,
+                              int* physical_memory,
+                              unsigned int words_physical,
+                              unsigned int access,
+                              unsigned int* physical_address);
+
+//Rewrites a page table in the original format, where each entry is the word address of its frame, into the PTE format. Entries pointing inside physical memory become present and user accessible, and writable unless their frame overlaps the page table itself; all others become not present. Returns false if physical memory is too large for the PTE format.
+extern bool convert_legacy_page_table(unsigned int page_table_loc,
+                                      unsigned int num_pages,
+                                      unsigned int frame_words,
+                                      unsigned int words_physical,
+                                      int* physical_memory);
+
 //Takes a virtual address and returns the value at the corresponding physical address. The virtual address, the number of bits used for the offset, the starting location of the page table(s), and a pointer to the physical memory are also passed as parameters.
 extern int read_value(unsigned int virtual_address,
                unsigned int page_mask,
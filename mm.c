@@ -0,0 +1,424 @@
+#include "mm.h"
+#include "memsim.h"
+#include "trace.h"
+#include "zswap.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool is_present(const struct address_space* mm, unsigned int page){
+    return mm->physical_memory[mm->page_table_loc + page] & PTE_PRESENT;
+}
+
+// page table entry flags for a page in an area with the given protection. Pages that cannot be read are not user
+// accessible, so every access to them goes through the area check.
+static unsigned int pte_flags(unsigned int prot){
+    return PTE_PRESENT | (prot & VMA_READ ? PTE_USER : 0) | (prot & VMA_WRITE ? PTE_WRITABLE : 0);
+}
+
+// whether a page on the frame starting at word base would overlap the page table, as pages of an image can
+static bool on_page_table(const struct address_space* mm, unsigned int base){
+    return base < mm->page_table_loc + mm->num_pages && base + mm->frame_words > mm->page_table_loc;
+}
+
+// flags for a present entry in an area with the given protection, keeping the bits the entry already has. A shared
+// page stays read only until a write gives it its own frame, and a page on the page table stays read only for good.
+static unsigned int entry_flags(const struct address_space* mm, unsigned int prot, int entry){
+    unsigned int flags = pte_flags(prot) | (entry & (PTE_ACCESSED | PTE_DIRTY | PTE_SHARED));
+    return entry & PTE_SHARED || on_page_table(mm, PTE_FRAME(entry)) ? flags & ~PTE_WRITABLE : flags;
+}
+
+// frame_refs index of the frames covered by a page starting at word base. Frames read from an image are not always
+// aligned, so a page can straddle two frames.
+static void frames_of(const struct address_space* mm, unsigned int base, unsigned int* first, unsigned int* last){
+    *first = base / mm->frame_words;
+    *last = (base + mm->frame_words - 1) / mm->frame_words;
+}
+
+// the first reference takes the frame out of the allocator, which does nothing for a frame from buddy_alloc()
+static void ref_frame(struct address_space* mm, unsigned int frame){
+    if (mm->frame_refs[frame]++ == 0){
+        buddy_reserve(&mm->frames, frame);
+    }
+}
+
+static void unref_frame(struct address_space* mm, unsigned int frame){
+    if (--mm->frame_refs[frame] == 0){
+        buddy_free(&mm->frames, frame, 0);
+    }
+}
+
+static void invalidate_tlb(struct address_space* mm, unsigned int page){
+    if (mm->tlb != NULL){
+        tlb_invalidate(mm->tlb, page);
+    }
+}
+
+static unsigned int pt_frame_of(const struct address_space* mm, unsigned int page){
+    return (mm->page_table_loc + page) / mm->frame_words - mm->pt_first_frame;
+}
+
+// point the page table entry of page at the frame starting at word base
+static void set_present(struct address_space* mm, unsigned int page, unsigned int base, unsigned int flags){
+    unsigned int first, last;
+    frames_of(mm, base, &first, &last);
+    for (unsigned int f = first; f <= last; ++f) {
+        ref_frame(mm, f);
+    }
+    mm->physical_memory[mm->page_table_loc + page] = PTE_MAKE(base, flags);
+    invalidate_tlb(mm, page);
+    if (mm->pt_live[pt_frame_of(mm, page)]++ == 0){
+        ++mm->pt_frames_live;
+    }
+}
+
+// point a present page at the frame starting at word base instead of its current one
+static void replace_frame(struct address_space* mm, unsigned int page, unsigned int base, unsigned int flags){
+    int* entry = &mm->physical_memory[mm->page_table_loc + page];
+    unsigned int first, last, old_first, old_last;
+    frames_of(mm, base, &first, &last);
+    frames_of(mm, PTE_FRAME(*entry), &old_first, &old_last);
+    // take the new frames first, the page may already be on them
+    for (unsigned int f = first; f <= last; ++f) {
+        ref_frame(mm, f);
+    }
+    for (unsigned int f = old_first; f <= old_last; ++f) {
+        unref_frame(mm, f);
+    }
+    *entry = PTE_MAKE(base, flags);
+    invalidate_tlb(mm, page);
+}
+
+static void trace(struct address_space* mm, enum trace_type type, unsigned int detail, unsigned int address,
+                  unsigned int value){
+    if (mm->tracer != NULL){
+        trace_event(mm->tracer, type, detail, address, value);
+    }
+}
+
+// forget a present or swapped out page
+static void clear_present(struct address_space* mm, unsigned int page){
+    int entry = mm->physical_memory[mm->page_table_loc + page];
+    unsigned int first, last;
+    frames_of(mm, PTE_FRAME(entry), &first, &last);
+    if (entry & PTE_SWAPPED){
+        zswap_drop(mm->zswap, PTE_FRAME(entry));
+    }
+    for (unsigned int f = first; !(entry & PTE_SWAPPED) && f <= last; ++f) {
+        unref_frame(mm, f);
+    }
+    mm->physical_memory[mm->page_table_loc + page] = 0;
+    invalidate_tlb(mm, page);
+    if (--mm->pt_live[pt_frame_of(mm, page)] == 0){
+        --mm->pt_frames_live;
+        ++mm->pt_frames_emptied;
+    }
+}
+
+static void invalidate_vma_cache(struct address_space* mm){
+    memset(mm->vma_cache, 0, sizeof(mm->vma_cache));
+}
+
+// check that start is page aligned and that start + length, rounded up to a page, stays inside virtual memory
+static bool page_range(const struct address_space* mm, unsigned int start, unsigned int length, unsigned int* end){
+    if (length == 0 || start % mm->frame_words != 0 || start >= mm->words_virtual
+        || length > mm->words_virtual - start){
+        return false;
+    }
+    *end = start + ((length + mm->frame_words - 1) & ~(mm->frame_words - 1));
+    return *end <= mm->words_virtual;
+}
+
+// move the next page the clock finds unused since its last visit to the compressed tier. Only pages alone on an
+// aligned frame are taken, the same ones same-page merging takes.
+static bool evict_page(struct address_space* mm){
+    for (unsigned int step = 0; step < 2 * mm->num_pages; ++step) {
+        unsigned int page = mm->clock_hand;
+        mm->clock_hand = (page + 1) % mm->num_pages;
+        int* entry = &mm->physical_memory[mm->page_table_loc + page];
+        unsigned int base = PTE_FRAME(*entry);
+        if ((*entry & (PTE_PRESENT | PTE_SHARED)) != PTE_PRESENT || (base & (mm->frame_words - 1)) != 0
+            || mm->frame_refs[base / mm->frame_words] != 1){
+            continue;
+        }
+        if (*entry & PTE_ACCESSED){
+            *entry &= ~PTE_ACCESSED;
+            continue;
+        }
+        // the frame is given back first so the pool can take it for the compressed copy
+        unref_frame(mm, base / mm->frame_words);
+        unsigned int handle;
+        if (!zswap_store(mm->zswap, &mm->physical_memory[base], &handle)){
+            ref_frame(mm, base / mm->frame_words);
+            return false;
+        }
+        *entry = PTE_MAKE(handle, PTE_SWAPPED | (*entry & PTE_FLAGS_MASK & ~(PTE_PRESENT | PTE_ACCESSED)));
+        invalidate_tlb(mm, page);
+        ++mm->evictions;
+        trace(mm, TRACE_EVICT, 0, page, handle);
+        if (*entry & PTE_DIRTY){
+            trace(mm, TRACE_WRITEBACK, 0, page, handle);
+        }
+        return true;
+    }
+    return false;
+}
+
+// a frame from the allocator, evicting pages while there is none and a compressed tier to evict them to
+static int alloc_frame(struct address_space* mm){
+    int frame = buddy_alloc(&mm->frames, 0);
+    while (frame < 0 && mm->zswap != NULL && evict_page(mm)){
+        frame = buddy_alloc(&mm->frames, 0);
+    }
+    return frame;
+}
+
+// drop the frames of every present page in [start, end)
+static void unmap_pages(struct address_space* mm, unsigned int start, unsigned int end){
+    for (unsigned int page = start >> mm->offset_bits; page < end >> mm->offset_bits; ++page) {
+        if (mm->physical_memory[mm->page_table_loc + page] & (PTE_PRESENT | PTE_SWAPPED)){
+            clear_present(mm, page);
+        }
+    }
+}
+
+bool mm_init(struct address_space* mm,
+             int* physical_memory,
+             unsigned int words_virtual,
+             unsigned int words_physical,
+             unsigned int frame_words,
+             unsigned int page_table_loc){
+    *mm = (struct address_space){
+        .physical_memory = physical_memory,
+        .words_virtual = words_virtual,
+        .words_physical = words_physical,
+        .frame_words = frame_words,
+        .offset_bits = __builtin_ctz(frame_words),
+        .kernel = kernel_for_frame_words(frame_words),
+        .page_table_loc = page_table_loc,
+        .num_pages = words_virtual / frame_words,
+    };
+    if (page_table_loc > words_physical || mm->num_pages > words_physical - page_table_loc){
+        return false;
+    }
+    mm->pt_first_frame = page_table_loc / frame_words;
+    mm->pt_frames = (page_table_loc + mm->num_pages - 1) / frame_words - mm->pt_first_frame + 1;
+    if (!buddy_init(&mm->frames, words_physical / frame_words)){
+        return false;
+    }
+    // the pages up to the last present one are the image's area, the heap starts right after it
+    unsigned int image_pages = mm->num_pages;
+    while (image_pages > 0 && !(physical_memory[page_table_loc + image_pages - 1] & PTE_PRESENT)){
+        --image_pages;
+    }
+    mm->start_brk = mm->brk = image_pages * frame_words;
+    mm->frame_refs = calloc(mm->frames.num_frames, sizeof(unsigned int));
+    mm->pt_live = calloc(mm->pt_frames, sizeof(unsigned int));
+    if (mm->frame_refs == NULL || mm->pt_live == NULL
+        || (image_pages > 0 && !vma_insert(&mm->vmas, 0, mm->start_brk, VMA_READ | VMA_WRITE))){
+        mm_destroy(mm);
+        return false;
+    }
+    for (unsigned int f = 0; f < mm->pt_frames; ++f) {
+        ref_frame(mm, mm->pt_first_frame + f);
+    }
+    for (unsigned int page = 0; page < mm->num_pages; ++page) {
+        int entry = physical_memory[page_table_loc + page];
+        if (entry & PTE_PRESENT){
+            set_present(mm, page, PTE_FRAME(entry), entry & PTE_FLAGS_MASK);
+        }
+    }
+    return true;
+}
+
+void mm_destroy(struct address_space* mm){
+    vma_destroy(&mm->vmas);
+    free(mm->pt_live);
+    free(mm->frame_refs);
+    buddy_destroy(&mm->frames);
+}
+
+struct vma* mm_find_vma(struct address_space* mm, unsigned int virtual_address){
+    struct vma** slot = &mm->vma_cache[(virtual_address >> mm->offset_bits) % MM_VMA_CACHE_SIZE];
+    if (*slot != NULL && (*slot)->start <= virtual_address && virtual_address < (*slot)->end){
+        ++mm->vma_cache_hits;
+        return *slot;
+    }
+    ++mm->vma_cache_misses;
+    struct vma* area = vma_find(&mm->vmas, virtual_address);
+    if (area != NULL){
+        *slot = area;
+    }
+    return area;
+}
+
+enum mm_fault mm_access(struct address_space* mm,
+                        unsigned int virtual_address,
+                        unsigned int access,
+                        unsigned int* physical_address){
+    if (virtual_address >= mm->words_virtual){
+        ++mm->faults[MM_FAULT_SEGV];
+        trace(mm, TRACE_FAULT, MM_FAULT_SEGV, virtual_address, 0);
+        return MM_FAULT_SEGV;
+    }
+    if (mm->shards != NULL){
+        shards_access(mm->shards, virtual_address >> mm->offset_bits);
+    }
+    unsigned int pte_access = access == VMA_WRITE ? PTE_WRITABLE : 0;
+    if (mm->kernel->translate(virtual_address, mm->offset_bits, mm->page_table_loc, mm->physical_memory,
+                              mm->words_physical, pte_access, physical_address)){
+        ++mm->faults[MM_OK];
+        if (mm->tlb != NULL){
+            tlb_access(mm->tlb, virtual_address >> mm->offset_bits);
+        }
+        if (mm->wss != NULL){
+            wss_access(mm->wss, virtual_address >> mm->offset_bits);
+        }
+        trace(mm, TRACE_TRANSLATE, 0, virtual_address, *physical_address);
+        return MM_OK;
+    }
+    // the entry did not allow the access, find out why from the area
+    enum mm_fault result = MM_OK;
+    unsigned int page = virtual_address >> mm->offset_bits;
+    struct vma* area = mm_find_vma(mm, virtual_address);
+    if (area == NULL){
+        result = MM_FAULT_SEGV;
+    }else if ((area->prot & access) != access){
+        result = MM_FAULT_PROTECTION;
+    }else if (!is_present(mm, page)){
+        // first touch of a mapped page: back it with a zeroed frame, or with the page again if it was evicted
+        int entry = mm->physical_memory[mm->page_table_loc + page];
+        int frame = alloc_frame(mm);
+        if (frame < 0){
+            result = MM_FAULT_OOM;
+        }else if (entry & PTE_SWAPPED){
+            // the entry already counts in pt_live, only the frame is new
+            unsigned int base = (unsigned int) frame * mm->frame_words;
+            zswap_load(mm->zswap, PTE_FRAME(entry), &mm->physical_memory[base]);
+            ref_frame(mm, (unsigned int) frame);
+            mm->physical_memory[mm->page_table_loc + page] = PTE_MAKE(base, pte_flags(area->prot)
+                                                                             | (entry & PTE_DIRTY));
+            result = MM_FAULT_SWAP;
+        }else{
+            unsigned int base = (unsigned int) frame * mm->frame_words;
+            memset(&mm->physical_memory[base], 0, mm->frame_words * sizeof(int));
+            set_present(mm, page, base, pte_flags(area->prot));
+            result = MM_FAULT_LAZY;
+        }
+    }else if (access == VMA_WRITE && (mm->physical_memory[mm->page_table_loc + page] & PTE_SHARED)){
+        // write to a shared page: copy the frame and stop sharing it
+        int frame = alloc_frame(mm);
+        if (frame < 0){
+            result = MM_FAULT_OOM;
+        }else{
+            int entry = mm->physical_memory[mm->page_table_loc + page];
+            unsigned int base = (unsigned int) frame * mm->frame_words;
+            memcpy(&mm->physical_memory[base], &mm->physical_memory[PTE_FRAME(entry)], mm->frame_words * sizeof(int));
+            replace_frame(mm, page, base, entry & PTE_FLAGS_MASK & ~PTE_SHARED);
+            result = MM_FAULT_COW;
+        }
+    }else if (PTE_FRAME(mm->physical_memory[mm->page_table_loc + page]) > mm->words_physical - mm->frame_words){
+        // an entry pointing past physical memory, which only a write into the page table could have left
+        result = MM_FAULT_SEGV;
+    }else if (access == VMA_WRITE && on_page_table(mm, PTE_FRAME(mm->physical_memory[mm->page_table_loc + page]))){
+        result = MM_FAULT_PROTECTION;
+    }
+    ++mm->faults[result];
+    if (MM_SUCCEEDED(result)){
+        // the area allows the access, so complete it even where the entry alone would not (write-only areas)
+        int* entry = &mm->physical_memory[mm->page_table_loc + page];
+        *entry = PTE_MAKE(PTE_FRAME(*entry), entry_flags(mm, area->prot, *entry) | PTE_ACCESSED
+                                             | (pte_access ? PTE_DIRTY : 0));
+        *physical_address = PTE_FRAME(*entry) + (virtual_address & (mm->frame_words - 1));
+        if (mm->tlb != NULL){
+            tlb_access(mm->tlb, page);
+        }
+        if (mm->wss != NULL){
+            wss_access(mm->wss, page);
+        }
+    }
+    if (result != MM_OK){
+        trace(mm, TRACE_FAULT, result, virtual_address, MM_SUCCEEDED(result) ? *physical_address : 0);
+    }
+    if (MM_SUCCEEDED(result)){
+        trace(mm, TRACE_TRANSLATE, 1, virtual_address, *physical_address);
+    }
+    return result;
+}
+
+bool mm_mmap(struct address_space* mm, unsigned int start, unsigned int length, unsigned int prot){
+    unsigned int end;
+    if (!page_range(mm, start, length, &end) || !mm_munmap(mm, start, length)){
+        return false;
+    }
+    invalidate_vma_cache(mm);
+    return vma_insert(&mm->vmas, start, end, prot);
+}
+
+bool mm_munmap(struct address_space* mm, unsigned int start, unsigned int length){
+    unsigned int end;
+    if (!page_range(mm, start, length, &end)){
+        return false;
+    }
+    unmap_pages(mm, start, end);
+    invalidate_vma_cache(mm);
+    return vma_remove_range(&mm->vmas, start, end);
+}
+
+bool mm_mprotect(struct address_space* mm, unsigned int start, unsigned int length, unsigned int prot){
+    unsigned int end;
+    if (!page_range(mm, start, length, &end)){
+        return false;
+    }
+    invalidate_vma_cache(mm);
+    if (!vma_protect_range(&mm->vmas, start, end, prot)){
+        return false;
+    }
+    // bring the present entries in line with the new protection
+    for (unsigned int page = start >> mm->offset_bits; page < end >> mm->offset_bits; ++page) {
+        int* entry = &mm->physical_memory[mm->page_table_loc + page];
+        if (*entry & PTE_PRESENT){
+            *entry = PTE_MAKE(PTE_FRAME(*entry), entry_flags(mm, prot, *entry));
+            invalidate_tlb(mm, page);
+        }
+    }
+    return true;
+}
+
+void mm_share_page(struct address_space* mm, unsigned int page, unsigned int base){
+    int entry = mm->physical_memory[mm->page_table_loc + page];
+    replace_frame(mm, page, base, (entry & PTE_FLAGS_MASK & ~PTE_WRITABLE) | PTE_SHARED);
+}
+
+void mm_pin_frame(struct address_space* mm, unsigned int frame){
+    ref_frame(mm, frame);
+}
+
+void mm_unpin_frame(struct address_space* mm, unsigned int frame){
+    unref_frame(mm, frame);
+}
+
+bool mm_brk(struct address_space* mm, unsigned int new_brk){
+    unsigned int page_mask = mm->frame_words - 1;
+    if (new_brk < mm->start_brk || new_brk > mm->words_virtual){
+        return false;
+    }
+    unsigned int old_end = (mm->brk + page_mask) & ~page_mask, new_end = (new_brk + page_mask) & ~page_mask;
+    if (new_end > old_end){
+        if (vma_first_overlap(&mm->vmas, old_end, new_end) != NULL){
+            return false;
+        }
+        // grow the heap area in place when there is one, so the heap stays a single area
+        struct vma* heap = old_end > mm->start_brk ? vma_find(&mm->vmas, old_end - 1) : NULL;
+        if (heap != NULL && heap->prot == (VMA_READ | VMA_WRITE)){
+            heap->end = new_end;
+        }else if (!vma_insert(&mm->vmas, old_end, new_end, VMA_READ | VMA_WRITE)){
+            return false;
+        }
+        invalidate_vma_cache(mm);
+    }else if (new_end < old_end && !mm_munmap(mm, new_end, old_end - new_end)){
+        return false;
+    }
+    mm->brk = new_brk;
+    return true;
+}
@@ -0,0 +1,111 @@
+#ifndef CHALLENGE6_MM_H
+#define CHALLENGE6_MM_H
+#include <stdbool.h>
+#include "buddy.h"
+#include "kernels.h"
+#include "shards.h"
+#include "tlb.h"
+#include "vma.h"
+#include "wss.h"
+
+struct tracer;
+struct zswap;
+
+// Number of recently used areas remembered per address space, indexed by page number.
+#define MM_VMA_CACHE_SIZE 4
+
+// How an access was resolved. MM_FAULT_LAZY means the page was mapped but had no frame yet and one was allocated,
+// MM_FAULT_COW that a write to a shared page got the page a private copy of its frame and MM_FAULT_SWAP that the page
+// was brought back from the compressed tier, so the access still succeeded; the other faults leave the physical
+// address unset.
+enum mm_fault {
+    MM_OK,
+    MM_FAULT_LAZY,
+    MM_FAULT_COW,
+    MM_FAULT_SWAP,
+    MM_FAULT_PROTECTION,
+    MM_FAULT_SEGV,
+    MM_FAULT_OOM,
+    MM_FAULT_TYPES
+};
+
+// True when the access was done, whether or not a frame had to be found for it first.
+#define MM_SUCCEEDED(fault) ((fault) <= MM_FAULT_SWAP)
+
+// The simulated address space: the physical memory with its single-level page table at page_table_loc, the frames
+// backing it and the areas that are mapped.
+struct address_space {
+    int* physical_memory;
+    unsigned int words_virtual;
+    unsigned int words_physical;
+    unsigned int frame_words;
+    unsigned int offset_bits;
+    const struct translation_kernel* kernel; // translation compiled for the page size, picked by mm_init()
+    unsigned int page_table_loc;
+    unsigned int num_pages;
+    struct buddy_allocator frames;
+    unsigned int* frame_refs;     // pages mapping each frame, the page table pins its frames with one extra reference
+                                  // for good: a single-level table sits at fixed words, so its frames cannot be lent out
+    unsigned int* pt_live;        // present or swapped out entries in each frame of the page table
+    unsigned int pt_first_frame;
+    unsigned int pt_frames;
+    unsigned int pt_frames_live;  // page table frames with at least one entry in use
+    struct vma_tree vmas;
+    struct vma* vma_cache[MM_VMA_CACHE_SIZE];
+    unsigned int start_brk;       // end of the image's area, where the heap starts
+    unsigned int brk;
+    struct translation_cache* tlb; // optional, told about every translation and every page table entry change
+    struct shards* shards;         // optional, told about the page of every access inside virtual memory
+    struct wss* wss;               // optional, told about the page of every access that succeeds
+    struct zswap* zswap;           // optional, pages are evicted to it when no frame is free
+    struct tracer* tracer;         // optional, told about every translation, fault, eviction and writeback
+    unsigned int clock_hand;       // next page the eviction clock looks at
+    unsigned long long evictions;
+    unsigned long long faults[MM_FAULT_TYPES];
+    unsigned long long vma_cache_hits;
+    unsigned long long vma_cache_misses;
+    unsigned long long pt_frames_emptied; // times a page table frame lost its last entry in use
+};
+
+//Sets up an address space over an image already loaded into physical_memory, with its page table in the PTE format (see convert_legacy_page_table()). The pages up to the last present one are mapped read/write as one area and the present entries keep their frames; the pages above it are left unmapped for the heap, which starts there. Returns false if memory could not be allocated.
+extern bool mm_init(struct address_space* mm,
+                    int* physical_memory,
+                    unsigned int words_virtual,
+                    unsigned int words_physical,
+                    unsigned int frame_words,
+                    unsigned int page_table_loc);
+
+//Releases everything mm_init() allocated. The physical memory itself belongs to the caller.
+extern void mm_destroy(struct address_space* mm);
+
+//Translates a virtual address for a read or a write (VMA_READ or VMA_WRITE), allocating a frame on the first touch of a mapped page, copying a shared frame on a write and bringing back an evicted page. When no frame is free and a compressed tier is set, the least recently used pages by the clock algorithm are evicted to it. The page table entry is checked first and the areas are only looked up when it does not allow the access. The physical address is stored only when MM_SUCCEEDED() holds for the result.
+extern enum mm_fault mm_access(struct address_space* mm,
+                               unsigned int virtual_address,
+                               unsigned int access,
+                               unsigned int* physical_address);
+
+//Returns the area containing the address, going through the per address space lookup cache.
+extern struct vma* mm_find_vma(struct address_space* mm, unsigned int virtual_address);
+
+//Maps length words at start with the given protection, replacing whatever was mapped there. Frames are allocated on first touch. Start must be page aligned. Returns false on a bad range.
+extern bool mm_mmap(struct address_space* mm, unsigned int start, unsigned int length, unsigned int prot);
+
+//Unmaps length words at start and gives their frames back. Start must be page aligned. Returns false on a bad range.
+extern bool mm_munmap(struct address_space* mm, unsigned int start, unsigned int length);
+
+//Changes the protection of length words at start. The whole range has to be mapped. Returns false otherwise.
+extern bool mm_mprotect(struct address_space* mm, unsigned int start, unsigned int length, unsigned int prot);
+
+//Points a present page at the frame starting at word base and marks it PTE_SHARED, so the next write to it copies the frame. The frame the page had is given up. Base must be frame aligned.
+extern void mm_share_page(struct address_space* mm, unsigned int page, unsigned int base);
+
+//Takes an extra reference on a frame so it stays allocated while no page maps it.
+extern void mm_pin_frame(struct address_space* mm, unsigned int frame);
+
+//Drops a reference taken with mm_pin_frame(). The frame goes back to the allocator once nothing references it.
+extern void mm_unpin_frame(struct address_space* mm, unsigned int frame);
+
+//Moves the program break, which mm_init() puts at the end of the image's area. Returns false if the break cannot move there; mm->brk keeps the current break either way.
+extern bool mm_brk(struct address_space* mm, unsigned int new_brk);
+
+#endif // CHALLENGE6_MM_H
@@ -0,0 +1,337 @@
+#include "parse.h"
+#include "memsim.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+enum parse_status {
+    PARSE_OK,
+    PARSE_NOT_A_NUMBER,
+    PARSE_OUT_OF_RANGE
+};
+
+struct mapped_file {
+    const char* data;
+    const char* end;
+    size_t size;
+};
+
+// Hands out the lines of a file. Newlines are found 16 bytes at a time: mask has a bit set for every newline in the
+// block starting at block that has not been handed out yet.
+struct line_scanner {
+    const char* data;
+    const char* end;
+    const char* next;
+    const char* block;
+    unsigned int mask;
+    unsigned long line;
+};
+
+static void set_error(struct parse_error* error, unsigned long line, unsigned long column, const char* message){
+    error->line = line;
+    error->column = column;
+    snprintf(error->message, sizeof(error->message), "%s", message);
+}
+
+static bool map_file(const char* path, struct mapped_file* file, struct parse_error* error){
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0){
+        set_error(error, 0, 0, "file could not be opened");
+        if (fd >= 0){
+            close(fd);
+        }
+        return false;
+    }
+    file->size = (size_t) info.st_size;
+    file->data = file->size == 0 ? NULL : mmap(NULL, file->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (file->size == 0 || file->data == MAP_FAILED){
+        set_error(error, 0, 0, file->size == 0 ? "file is empty" : "file could not be mapped");
+        return false;
+    }
+    madvise((void*) file->data, file->size, MADV_SEQUENTIAL);
+    file->end = file->data + file->size;
+    return true;
+}
+
+static void unmap_file(struct mapped_file* file){
+    munmap((void*) file->data, file->size);
+}
+
+static void scanner_init(struct line_scanner* scanner, const struct mapped_file* file){
+    *scanner = (struct line_scanner){ .data = file->data, .end = file->end, .next = file->data };
+}
+
+static const char* find_newline(struct line_scanner* scanner){
+    while (scanner->mask == 0){
+        scanner->block = scanner->block == NULL ? scanner->data : scanner->block + 16;
+        if (scanner->block >= scanner->end){
+            return scanner->end;
+        }
+        size_t left = scanner->end - scanner->block;
+#ifdef __SSE2__
+        if (left >= 16){
+            __m128i bytes = _mm_loadu_si128((const __m128i*) scanner->block);
+            scanner->mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+            continue;
+        }
+#endif
+        for (size_t i = 0; i < left && i < 16; ++i) {
+            scanner->mask |= (unsigned int) (scanner->block[i] == '\n') << i;
+        }
+    }
+    const char* newline = scanner->block + __builtin_ctz(scanner->mask);
+    scanner->mask &= scanner->mask - 1;
+    return newline;
+}
+
+// the next line without its line break, false at the end of the file
+static bool next_line(struct line_scanner* scanner, const char** start, const char** stop){
+    if (scanner->next >= scanner->end){
+        return false;
+    }
+    const char* newline = find_newline(scanner);
+    *start = scanner->next;
+    *stop = (newline > *start && newline[-1] == '\r') ? newline - 1 : newline;
+    scanner->next = newline + 1;
+    ++scanner->line;
+    return true;
+}
+
+static const char* skip_blanks(const char* p, const char* stop){
+    while (p < stop && (*p == ' ' || *p == '\t')){
+        ++p;
+    }
+    return p;
+}
+
+// number of decimal digits at the start of 8 bytes, found without looking at the bytes one by one
+static unsigned int digit_run(uint64_t chunk){
+    uint64_t values = chunk ^ 0x3030303030303030ull;
+    uint64_t non_digits = ((values + 0x7676767676767676ull) | values) & 0x8080808080808080ull;
+    return non_digits == 0 ? 8 : __builtin_ctzll(non_digits) / 8;
+}
+
+// value of the first count (1 to 8) digits of 8 bytes, combining pairs, then quads, then the halves
+static uint64_t digits_value(uint64_t chunk, unsigned int count){
+    uint64_t values = (chunk ^ 0x3030303030303030ull) << (8 * (8 - count));
+    values = (values * 10 + (values >> 8)) & 0x00ff00ff00ff00ffull;
+    values = (values * 100 + (values >> 16)) & 0x0000ffff0000ffffull;
+    return (values * 10000 + (values >> 32)) & 0xffffffffull;
+}
+
+// parse an optionally negative decimal int at *cursor, stopping at stop. Reads up to 8 bytes ahead as long as they are
+// before limit, the end of the mapped file.
+static enum parse_status parse_int(const char** cursor, const char* stop, const char* limit, int* value){
+    const char* p = *cursor;
+    bool negative = (p < stop && *p == '-');
+    p += negative;
+    // leading zeros, which fscanf() takes too, do not count against the ten digits an int can have
+    const char* zeros = p;
+    while (p < stop && *p == '0'){
+        ++p;
+    }
+    uint64_t magnitude = 0;
+    unsigned int digits = 0;
+    if (limit - p >= 8){
+        uint64_t chunk;
+        memcpy(&chunk, p, 8);
+        digits = digit_run(chunk);
+        if (digits > (size_t) (stop - p)){
+            digits = stop - p;
+        }
+        if (digits != 0){
+            magnitude = digits_value(chunk, digits);
+            p += digits;
+        }
+    }
+    // the rest of a long number, or a short one near the end of the file
+    for (unsigned int d; p < stop && (d = (unsigned int) (*p - '0')) < 10 && digits <= 10; ++p, ++digits) {
+        magnitude = magnitude * 10 + d;
+    }
+    *cursor = p;
+    if (digits == 0 && p == zeros){
+        return PARSE_NOT_A_NUMBER;
+    }
+    if (digits > 10 || magnitude > (uint64_t) INT_MAX + negative){
+        return PARSE_OUT_OF_RANGE;
+    }
+    *value = (int) (negative ? -(long long) magnitude : (long long) magnitude);
+    return PARSE_OK;
+}
+
+// parse one number and set a precise error when it is missing or too large
+static bool parse_number(const char** cursor, const char* line_start, const char* stop, const char* limit,
+                         unsigned long line, int* value, struct parse_error* error){
+    const char* start = *cursor;
+    enum parse_status status = parse_int(cursor, stop, limit, value);
+    if (status == PARSE_NOT_A_NUMBER){
+        set_error(error, line, start - line_start + 1, "expected a decimal integer");
+    }else if (status == PARSE_OUT_OF_RANGE){
+        set_error(error, line, start - line_start + 1, "integer out of range");
+    }
+    return status == PARSE_OK;
+}
+
+// check the four header values and allocate the physical memory they describe
+static bool accept_header(const int header[4], struct memsim_image* image, unsigned long line,
+                          struct parse_error* error){
+    for (int i = 0; i < 4; ++i) {
+        if (header[i] < 0 || (i < 3 && header[i] == 0)){
+            snprintf(error->message, sizeof(error->message), "header value %d must be positive", i + 1);
+            error->line = line;
+            error->column = 0;
+            return false;
+        }
+    }
+    *image = (struct memsim_image){ header[0], header[1], header[2], header[3], NULL };
+    if (!file_verification(header[0], header[1], header[2], header[3])
+        || image->frame_words > image->words_virtual || image->frame_words > image->words_physical){
+        set_error(error, line, 0, "header fails verification: sizes must be powers of two and the page table must "
+                                  "start on a frame boundary");
+        return false;
+    }
+    unsigned int num_pages = image->words_virtual / image->frame_words;
+    if (image->page_table_loc > image->words_physical || num_pages > image->words_physical - image->page_table_loc){
+        set_error(error, line, 0, "page table does not fit in physical memory");
+        return false;
+    }
+    image->physical_memory = calloc(image->words_physical, sizeof(int));
+    if (image->physical_memory == NULL){
+        set_error(error, line, 0, "physical memory could not be allocated");
+        return false;
+    }
+    return true;
+}
+
+bool load_image(const char* path, struct memsim_image* image, struct parse_error* error){
+    struct mapped_file file;
+    if (!map_file(path, &file, error)){
+        return false;
+    }
+    struct line_scanner scanner;
+    scanner_init(&scanner, &file);
+    int header[4];
+    unsigned int header_values = 0;
+    size_t words = 0;
+    bool ok = true;
+    image->physical_memory = NULL;
+    for (const char *start, *stop; ok && next_line(&scanner, &start, &stop);) {
+        const char* p = skip_blanks(start, stop);
+        int value;
+        if (p == stop){
+            continue;
+        }
+        if (!parse_number(&p, start, stop, file.end, scanner.line, &value, error)){
+            ok = false;
+        }else if ((p = skip_blanks(p, stop)) != stop){
+            set_error(error, scanner.line, p - start + 1, "expected one integer per line");
+            ok = false;
+        }else if (header_values < 4){
+            header[header_values++] = value;
+            ok = header_values < 4 || accept_header(header, image, scanner.line, error);
+        }else if (words == image->words_physical){
+            set_error(error, scanner.line, 0, "more words than physical memory holds");
+            ok = false;
+        }else{
+            image->physical_memory[words++] = value;
+        }
+    }
+    if (ok && header_values < 4){
+        set_error(error, scanner.line, 0, "header needs four values");
+        ok = false;
+    }else if (ok && words < image->page_table_loc + image->words_virtual / image->frame_words){
+        snprintf(error->message, sizeof(error->message),
+                 "truncated image: the page table ends at word %u but the file stops after %zu words",
+                 image->page_table_loc + image->words_virtual / image->frame_words, words);
+        error->line = scanner.line;
+        error->column = 0;
+        ok = false;
+    }
+    if (!ok){
+        free(image->physical_memory);
+        image->physical_memory = NULL;
+    }
+    unmap_file(&file);
+    return ok;
+}
+
+int command_arguments(char op){
+    switch (op) {
+        case 'h': case 'q': case 'f': case 'v': case 's': case 'c': case 'k': case 'z': case 'i': case 'l':
+            return 0;
+        case 't': case 'r': case 'b':
+            return 1;
+        case 'w': case 'u':
+            return 2;
+        case 'm': case 'p':
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+bool load_commands(const char* path, struct trace_command** commands, size_t* count, struct parse_error* error){
+    struct mapped_file file;
+    if (!map_file(path, &file, error)){
+        return false;
+    }
+    struct line_scanner scanner;
+    scanner_init(&scanner, &file);
+    size_t capacity = file.size / 4 + 1; // a command line takes at least four bytes
+    struct trace_command* decoded = malloc(capacity * sizeof(struct trace_command));
+    bool ok = decoded != NULL;
+    if (!ok){
+        set_error(error, 0, 0, "commands could not be allocated");
+    }
+    *count = 0;
+    for (const char *start, *stop; ok && next_line(&scanner, &start, &stop);) {
+        const char* p = skip_blanks(start, stop);
+        if (p == stop){
+            continue;
+        }
+        struct trace_command* command = &decoded[*count];
+        int argc = command_arguments(*p);
+        if (argc < 0 || (p + 1 < stop && p[1] != ' ' && p[1] != '\t')){
+            set_error(error, scanner.line, p - start + 1, "unknown command");
+            ok = false;
+            break;
+        }
+        *command = (struct trace_command){ .op = *p++, .argc = (unsigned char) argc, .line = scanner.line };
+        for (int i = 0; ok && i < argc; ++i) {
+            p = skip_blanks(p, stop);
+            ok = parse_number(&p, start, stop, file.end, scanner.line, &command->args[i], error);
+        }
+        if (ok && (p = skip_blanks(p, stop)) != stop){
+            set_error(error, scanner.line, p - start + 1, "too many arguments");
+            ok = false;
+        }
+        if (ok && ++*count == capacity){
+            struct trace_command* grown = realloc(decoded, 2 * capacity * sizeof(struct trace_command));
+            if (grown == NULL){
+                set_error(error, scanner.line, 0, "commands could not be allocated");
+                ok = false;
+            }
+            decoded = grown == NULL ? decoded : grown;
+            capacity *= 2;
+        }
+    }
+    unmap_file(&file);
+    if (!ok){
+        free(decoded);
+        return false;
+    }
+    *commands = decoded;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef CHALLENGE6_PARSE_H
+#define CHALLENGE6_PARSE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+// Where and why a text file was rejected. Lines and columns count from 1; a column of 0 means the whole line.
+struct parse_error {
+    unsigned long line;
+    unsigned long column;
+    char message[128];
+};
+
+// A mem_file: the four header values followed by the first words of physical memory. Words the file leaves out are 0.
+struct memsim_image {
+    unsigned int words_virtual;
+    unsigned int words_physical;
+    unsigned int frame_words;
+    unsigned int page_table_loc;
+    int* physical_memory;
+};
+
+// One decoded trace line, e.g. "w 17 20" becomes op 'w', argc 2, args {17, 20}.
+struct trace_command {
+    char op;
+    unsigned char argc;
+    unsigned int line;
+    int args[3];
+};
+
+//Maps a mem_file and parses it into image. The header has to pass file_verification() and the file has to reach at least the end of the page table; words past physical memory are an error too. Returns false with the position and reason in error otherwise.
+extern bool load_image(const char* path, struct memsim_image* image, struct parse_error* error);
+
+//Maps a command trace (one command per line, blank lines allowed) and decodes it into a newly allocated array of count commands. Returns false with the position and reason in error if a line is not a known command with the right number of decimal arguments.
+extern bool load_commands(const char* path, struct trace_command** commands, size_t* count, struct parse_error* error);
+
+//Returns the number of arguments a command takes, or -1 if op is not a command.
+extern int command_arguments(char op);
+
+#endif // CHALLENGE6_PARSE_H
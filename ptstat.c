@@ -0,0 +1,206 @@
+#include "ptstat.h"
+#include "memsim.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// marks a block a layout does not keep, and an empty line cache slot
+#define NO_SLOT UINT_MAX
+#define NO_LINE ULLONG_MAX
+
+static const char* LAYOUT_NAMES[PTSTAT_LAYOUTS] = {"flat", "8 byte entries", "two-level", "clustered"};
+
+// where a layout puts the entry of each page
+struct layout_map {
+    unsigned int start;           // words before the layout in its first line
+    unsigned int entry_words;
+    unsigned int block_pages;     // pages per directory entry, 0 without a directory
+    unsigned int directory_words; // rounded up to where the first block starts
+    const unsigned int* slot;     // place of each block among the blocks kept, NO_SLOT when it is not kept
+    unsigned long long words;     // everything the layout takes, directory included
+};
+
+struct line_cache {
+    unsigned long long lines[PTSTAT_CACHE_LINES];
+    unsigned long long last_used[PTSTAT_CACHE_LINES];
+    unsigned long long time;
+};
+
+static unsigned int div_up(unsigned long long value, unsigned int by){
+    return (unsigned int) ((value + by - 1) / by);
+}
+
+bool ptstat_init(struct ptstat* ptstat,
+                 const int* physical_memory,
+                 unsigned int page_table_loc,
+                 unsigned int num_pages,
+                 unsigned int frame_words,
+                 unsigned int history){
+    *ptstat = (struct ptstat){
+        .physical_memory = physical_memory,
+        .page_table_loc = page_table_loc,
+        .num_pages = num_pages,
+        .frame_words = frame_words,
+    };
+    if (history > PTSTAT_MAX_HISTORY){
+        return false;
+    }
+    if (history != 0){
+        unsigned int ring = 1;
+        while (ring < history){
+            ring *= 2;
+        }
+        ptstat->walks = malloc(ring * sizeof(unsigned int));
+        ptstat->ring_mask = ring - 1;
+    }
+    return history == 0 || ptstat->walks != NULL;
+}
+
+void ptstat_destroy(struct ptstat* ptstat){
+    free(ptstat->walks);
+    ptstat->walks = NULL;
+}
+
+void ptstat_walk(struct ptstat* ptstat, unsigned int page){
+    ptstat->walks[ptstat->total_walks++ & ptstat->ring_mask] = page;
+}
+
+const char* ptstat_layout_name(enum ptstat_layout layout){
+    return LAYOUT_NAMES[layout];
+}
+
+// number the blocks of block_pages pages that hold an entry in use, in page order. Returns how many there are.
+static unsigned int number_blocks(const struct ptstat* ptstat, unsigned int block_pages, unsigned int* slot){
+    unsigned int kept = 0;
+    for (unsigned int block = 0; block * block_pages < ptstat->num_pages; ++block) {
+        slot[block] = NO_SLOT;
+        for (unsigned int page = block * block_pages; page < ptstat->num_pages && page < (block + 1) * block_pages;
+             ++page) {
+            if (ptstat->physical_memory[ptstat->page_table_loc + page] & (PTE_PRESENT | PTE_SWAPPED)){
+                slot[block] = kept++;
+                break;
+            }
+        }
+    }
+    return kept;
+}
+
+// the lines a walk of the page reads in a layout. Returns how many, one or two.
+static unsigned int walk_lines(const struct layout_map* map, unsigned int page, unsigned long long lines[2]){
+    if (map->block_pages == 0){
+        lines[0] = (map->start + (unsigned long long) page * map->entry_words) / PTSTAT_LINE_WORDS;
+        return 1;
+    }
+    unsigned int block = page / map->block_pages;
+    lines[0] = (map->start + (unsigned long long) block) / PTSTAT_LINE_WORDS;
+    if (map->slot[block] == NO_SLOT){
+        // the directory says there is nothing below it
+        return 1;
+    }
+    lines[1] = (map->start + map->directory_words
+                + ((unsigned long long) map->slot[block] * map->block_pages + page % map->block_pages)
+                  * map->entry_words) / PTSTAT_LINE_WORDS;
+    return 2;
+}
+
+// look a line up in the LRU line cache, filling it in on a miss. Returns true on a hit.
+static bool cache_access(struct line_cache* cache, unsigned long long line){
+    unsigned int victim = 0;
+    ++cache->time;
+    for (unsigned int i = 0; i < PTSTAT_CACHE_LINES; ++i) {
+        if (cache->lines[i] == line){
+            cache->last_used[i] = cache->time;
+            return true;
+        }
+        if (cache->last_used[i] < cache->last_used[victim]){
+            victim = i;
+        }
+    }
+    cache->lines[victim] = line;
+    cache->last_used[victim] = cache->time;
+    return false;
+}
+
+// replay the recorded walks through one layout
+static void replay_walks(const struct ptstat* ptstat, const struct layout_map* map, unsigned long long walks,
+                         unsigned char* seen, struct ptstat_layout_report* layout){
+    struct line_cache cache = { .time = 0 };
+    for (unsigned int i = 0; i < PTSTAT_CACHE_LINES; ++i) {
+        cache.lines[i] = NO_LINE;
+    }
+    memset(seen, 0, div_up(map->start + map->words, PTSTAT_LINE_WORDS));
+    for (unsigned long long w = ptstat->total_walks - walks; w < ptstat->total_walks; ++w) {
+        unsigned long long lines[2];
+        unsigned int count = walk_lines(map, ptstat->walks[w & ptstat->ring_mask], lines);
+        for (unsigned int l = 0; l < count; ++l) {
+            layout->lines += !seen[lines[l]];
+            seen[lines[l]] = 1;
+            layout->misses += !cache_access(&cache, lines[l]);
+        }
+        layout->line_accesses += count;
+    }
+}
+
+bool ptstat_analyze(const struct ptstat* ptstat, struct ptstat_report* report){
+    unsigned int frame_words = ptstat->frame_words, num_pages = ptstat->num_pages;
+    unsigned int tables = div_up(num_pages, frame_words), clusters = div_up(num_pages, PTSTAT_LINE_WORDS);
+    *report = (struct ptstat_report){ .table_frames = tables };
+
+    // how full each frame of the table is
+    for (unsigned int f = 0; f < tables; ++f) {
+        unsigned int entries = f == tables - 1 ? num_pages - f * frame_words : frame_words, used = 0;
+        for (unsigned int e = 0; e < entries; ++e) {
+            used += (ptstat->physical_memory[ptstat->page_table_loc + f * frame_words + e]
+                     & (PTE_PRESENT | PTE_SWAPPED)) != 0;
+        }
+        report->used_entries += used;
+        ++report->density[used == 0 ? 0 : used == entries ? 5 : 1 + (4 * used - 1) / entries];
+    }
+
+    unsigned int* table_slot = malloc(tables * sizeof(unsigned int));
+    unsigned int* cluster_slot = malloc(clusters * sizeof(unsigned int));
+    if (table_slot == NULL || cluster_slot == NULL){
+        free(table_slot);
+        free(cluster_slot);
+        return false;
+    }
+    unsigned int kept_tables = number_blocks(ptstat, frame_words, table_slot);
+    unsigned int kept_clusters = number_blocks(ptstat, PTSTAT_LINE_WORDS, cluster_slot);
+
+    // the flat layouts stay where the table is, the others start on a fresh line
+    unsigned int table_start = ptstat->page_table_loc % PTSTAT_LINE_WORDS;
+    unsigned int directory_frames = div_up(tables, frame_words);
+    unsigned int directory_lines = div_up(clusters, PTSTAT_LINE_WORDS);
+    struct layout_map maps[PTSTAT_LAYOUTS] = {
+        [PTSTAT_FLAT] = { table_start, 1, 0, 0, NULL, num_pages },
+        [PTSTAT_WIDE] = { table_start, 2, 0, 0, NULL, 2ull * num_pages },
+        [PTSTAT_TWO_LEVEL] = { 0, 1, frame_words, directory_frames * frame_words, table_slot,
+                               (unsigned long long) (directory_frames + kept_tables) * frame_words },
+        [PTSTAT_CLUSTERED] = { 0, 1, PTSTAT_LINE_WORDS, directory_lines * PTSTAT_LINE_WORDS, cluster_slot,
+                               (unsigned long long) (directory_lines + kept_clusters) * PTSTAT_LINE_WORDS },
+    };
+    unsigned long long largest = 0;
+    for (unsigned int l = 0; l < PTSTAT_LAYOUTS; ++l) {
+        report->layouts[l].frames = div_up(maps[l].words, frame_words);
+        largest = maps[l].start + maps[l].words > largest ? maps[l].start + maps[l].words : largest;
+    }
+
+    // then how the most recent walks would spread over the lines of each
+    if (ptstat->walks != NULL){
+        unsigned char* seen = malloc(div_up(largest, PTSTAT_LINE_WORDS));
+        if (seen == NULL){
+            free(table_slot);
+            free(cluster_slot);
+            return false;
+        }
+        report->walks = ptstat->total_walks <= ptstat->ring_mask ? ptstat->total_walks : ptstat->ring_mask + 1ull;
+        for (unsigned int l = 0; l < PTSTAT_LAYOUTS; ++l) {
+            replay_walks(ptstat, &maps[l], report->walks, seen, &report->layouts[l]);
+        }
+        free(seen);
+    }
+    free(table_slot);
+    free(cluster_slot);
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef CHALLENGE6_PTSTAT_H
+#define CHALLENGE6_PTSTAT_H
+#include <stdbool.h>
+
+// Words per cache line (64 bytes of 4 byte words) and lines in the cache walks are modeled against.
+#define PTSTAT_LINE_WORDS 16
+#define PTSTAT_CACHE_LINES 64
+// Most walks remembered for the locality analysis.
+#define PTSTAT_MAX_HISTORY (1u << 24)
+// Table frames are counted by the share of their entries in use: empty, up to 25%, 50%, 75%, less than all, full.
+#define PTSTAT_DENSITY_BUCKETS 6
+
+// Page table layouts compared. Each walk touches one line in the flat layouts, and a directory line and, when the
+// block of pages has entries in use, an entry line in the other two.
+enum ptstat_layout {
+    PTSTAT_FLAT,      // the table as it is: one 4 byte entry per page at page_table_loc
+    PTSTAT_WIDE,      // the same with 8 byte entries
+    PTSTAT_TWO_LEVEL, // a directory of table frames, with only the table frames holding entries in use allocated
+    PTSTAT_CLUSTERED, // a directory of line sized blocks of entries, with only the blocks in use kept, packed together
+    PTSTAT_LAYOUTS
+};
+
+// Page table analyzer. It remembers the pages of the most recent walks in a ring so they can be replayed against the
+// table as it is and as it would be in other layouts.
+struct ptstat {
+    const int* physical_memory;
+    unsigned int page_table_loc;
+    unsigned int num_pages;
+    unsigned int frame_words;
+    unsigned int* walks;         // page of each recent walk, modulo the ring size; NULL when walks are not recorded
+    unsigned int ring_mask;
+    unsigned long long total_walks;
+};
+
+struct ptstat_layout_report {
+    unsigned int frames;              // frames the layout takes
+    unsigned int lines;               // distinct lines the walks touched
+    unsigned long long line_accesses;
+    unsigned long long misses;        // in an LRU cache of PTSTAT_CACHE_LINES lines that starts empty
+};
+
+struct ptstat_report {
+    unsigned int table_frames;
+    unsigned int used_entries;        // present or swapped out
+    unsigned int density[PTSTAT_DENSITY_BUCKETS];
+    unsigned long long walks;         // walks replayed, the most recent ones
+    struct ptstat_layout_report layouts[PTSTAT_LAYOUTS];
+};
+
+//Sets up an analyzer for the page table of num_pages entries at page_table_loc, which must be frame aligned, remembering the last history walks (rounded up to a power of two, at most PTSTAT_MAX_HISTORY). With history 0 no walks are recorded and only the footprint is analyzed. Returns false for a history that is too long or if memory could not be allocated.
+extern bool ptstat_init(struct ptstat* ptstat,
+                        const int* physical_memory,
+                        unsigned int page_table_loc,
+                        unsigned int num_pages,
+                        unsigned int frame_words,
+                        unsigned int history);
+
+//Releases the walk history.
+extern void ptstat_destroy(struct ptstat* ptstat);
+
+//Records a page table walk for the page.
+extern void ptstat_walk(struct ptstat* ptstat, unsigned int page);
+
+//Measures the table as it is now: its frames, the entries in use and how they fill each table frame, and for every layout the frames it would take and how the recorded walks spread over its lines. Returns false if memory for the analysis could not be allocated.
+extern bool ptstat_analyze(const struct ptstat* ptstat, struct ptstat_report* report);
+
+//Returns the name of a layout.
+extern const char* ptstat_layout_name(enum ptstat_layout layout);
+
+#endif // CHALLENGE6_PTSTAT_H
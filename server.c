@@ -0,0 +1,349 @@
+#define _GNU_SOURCE // accept4
+#include "server.h"
+#include "memsim.h"
+#include "mm.h"
+#include "parse.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// stop reading from a client while this much of its output is still waiting to be sent
+#define OUTPUT_LIMIT (4u << 20)
+#define READ_CHUNK (64u << 10)
+// most bytes read from one client in one wakeup, so a client that keeps sending cannot queue unbounded work before
+// its output is looked at
+#define READ_BUDGET (4 * READ_CHUNK)
+// how long the listening socket is left alone after an accept failed for want of descriptors or memory
+#define ACCEPT_BACKOFF_MS 100
+
+struct buffer {
+    unsigned char* data;
+    size_t start;
+    size_t length;
+    size_t capacity;
+};
+
+struct client {
+    int fd;
+    bool closing;  // no more requests are read, the connection closes once the output is sent
+    bool rejected; // a bad header was answered, whatever follows it in the input is ignored
+    struct buffer in;
+    struct buffer out;
+};
+
+struct server_image {
+    struct memsim_image image;
+    struct address_space mm;
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int signal){
+    (void) signal;
+    stopping = 1;
+}
+
+static bool reserve(struct buffer* buffer, size_t extra){
+    if (buffer->start > 0 && buffer->length + extra > buffer->capacity){
+        // move the unconsumed bytes to the front before growing
+        memmove(buffer->data, buffer->data + buffer->start, buffer->length - buffer->start);
+        buffer->length -= buffer->start;
+        buffer->start = 0;
+    }
+    if (buffer->length + extra <= buffer->capacity){
+        return true;
+    }
+    size_t capacity = buffer->capacity == 0 ? READ_CHUNK : buffer->capacity;
+    while (capacity < buffer->length + extra){
+        capacity *= 2;
+    }
+    unsigned char* data = realloc(buffer->data, capacity);
+    if (data == NULL){
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static bool append(struct buffer* buffer, const void* bytes, size_t size){
+    if (!reserve(buffer, size)){
+        return false;
+    }
+    memcpy(buffer->data + buffer->length, bytes, size);
+    buffer->length += size;
+    return true;
+}
+
+static size_t pending(const struct buffer* buffer){
+    return buffer->length - buffer->start;
+}
+
+static bool respond_status(struct client* client, enum ms_status status){
+    struct ms_response_header header = { MS_PROTOCOL_MAGIC, status, 0, 0 };
+    return append(&client->out, &header, sizeof(header));
+}
+
+// run one batch against an image and queue the response
+static bool run_batch(struct client* client, struct address_space* mm, uint32_t op,
+                      const unsigned char* entries, uint32_t count){
+    struct ms_response_header header = { MS_PROTOCOL_MAGIC, MS_STATUS_OK, count, 0 };
+    if (!append(&client->out, &header, sizeof(header))
+        || !reserve(&client->out, (size_t) count * sizeof(struct ms_response_entry))){
+        return false;
+    }
+    struct ms_response_entry* responses = (struct ms_response_entry*) (client->out.data + client->out.length);
+    for (uint32_t i = 0; i < count; ++i) {
+        struct ms_request_entry request;
+        memcpy(&request, entries + i * sizeof(request), sizeof(request));
+        unsigned int p_addr;
+        enum mm_fault fault = mm_access(mm, request.address, op == MS_OP_WRITE ? VMA_WRITE : VMA_READ, &p_addr);
+        struct ms_response_entry response = { fault, 0 };
+        if (MM_SUCCEEDED(fault)){
+            if (op == MS_OP_TRANSLATE){
+                response.value = (int32_t) p_addr;
+            }else if (op == MS_OP_READ){
+                response.value = read_value(p_addr, mm->offset_bits, mm->page_table_loc, mm->physical_memory);
+            }else{
+                write_value(request.value, p_addr, mm->offset_bits, mm->page_table_loc, mm->physical_memory);
+                response.value = request.value;
+            }
+        }
+        memcpy(&responses[i], &response, sizeof(response));
+    }
+    client->out.length += (size_t) count * sizeof(struct ms_response_entry);
+    return true;
+}
+
+// answer every complete request in the input buffer, also once the client has stopped sending; a partial one waits
+// for more bytes
+static bool handle_requests(struct client* client, struct server_image* images, int image_count){
+    while (!client->rejected && pending(&client->in) >= sizeof(struct ms_request_header)){
+        struct ms_request_header header;
+        memcpy(&header, client->in.data + client->in.start, sizeof(header));
+        if (header.magic != MS_PROTOCOL_MAGIC || header.count > MS_MAX_BATCH){
+            client->closing = client->rejected = true;
+            return respond_status(client, header.magic != MS_PROTOCOL_MAGIC ? MS_STATUS_BAD_MAGIC
+                                                                            : MS_STATUS_TOO_LARGE);
+        }
+        size_t size = sizeof(header) + (size_t) header.count * sizeof(struct ms_request_entry);
+        if (pending(&client->in) < size){
+            break;
+        }
+        const unsigned char* entries = client->in.data + client->in.start + sizeof(header);
+        bool ok;
+        if (header.image >= (uint32_t) image_count){
+            ok = respond_status(client, MS_STATUS_BAD_IMAGE);
+        }else if (header.op != MS_OP_TRANSLATE && header.op != MS_OP_READ && header.op != MS_OP_WRITE){
+            ok = respond_status(client, MS_STATUS_BAD_OP);
+        }else{
+            ok = run_batch(client, &images[header.image].mm, header.op, entries, header.count);
+        }
+        if (!ok){
+            return false;
+        }
+        client->in.start += size;
+    }
+    return true;
+}
+
+// read what the socket has, up to READ_BUDGET bytes, false once the connection is gone
+static bool receive(struct client* client){
+    for (size_t budget = READ_BUDGET; !client->closing && budget > 0;) {
+        if (!reserve(&client->in, READ_CHUNK)){
+            return false;
+        }
+        size_t room = client->in.capacity - client->in.length;
+        ssize_t got = read(client->fd, client->in.data + client->in.length, room < budget ? room : budget);
+        if (got > 0){
+            client->in.length += (size_t) got;
+            budget -= (size_t) got;
+            continue;
+        }
+        if (got == 0){
+            client->closing = true;
+        }
+        return got == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    return true;
+}
+
+static bool flush(struct client* client){
+    while (pending(&client->out) > 0){
+        ssize_t sent = send(client->fd, client->out.data + client->out.start, pending(&client->out), MSG_NOSIGNAL);
+        if (sent < 0){
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        client->out.start += (size_t) sent;
+    }
+    client->out.start = client->out.length = 0;
+    return true;
+}
+
+static void close_client(struct client* client){
+    close(client->fd);
+    free(client->in.data);
+    free(client->out.data);
+}
+
+static bool load_server_image(const char* path, struct server_image* loaded){
+    struct parse_error error;
+    struct memsim_image* image = &loaded->image;
+    if (!load_image(path, image, &error)){
+        printf("%s:%lu:%lu: %s\n", path, error.line, error.column, error.message);
+        return false;
+    }
+    if (!convert_legacy_page_table(image->page_table_loc, image->words_virtual / image->frame_words,
+                                   image->frame_words, image->words_physical, image->physical_memory)
+        || !mm_init(&loaded->mm, image->physical_memory, image->words_virtual, image->words_physical,
+                    image->frame_words, image->page_table_loc)){
+        printf("%s: image could not be set up\n", path);
+        free(image->physical_memory);
+        return false;
+    }
+    return true;
+}
+
+// remove a socket left at path by an earlier run, but nothing else that may be there. Returns false if the path is
+// taken by something that is not a socket.
+static bool remove_socket(const char* socket_path){
+    struct stat info;
+    if (lstat(socket_path, &info) != 0){
+        return errno == ENOENT;
+    }
+    return S_ISSOCK(info.st_mode) && (unlink(socket_path) == 0 || errno == ENOENT);
+}
+
+static int open_socket(const char* socket_path){
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)){
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0){
+        return -1;
+    }
+    if (!remove_socket(socket_path) || bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(fd, 64) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve(const char* socket_path, const char** image_paths, int image_count){
+    struct server_image* images = calloc(image_count, sizeof(struct server_image));
+    int loaded = 0;
+    while (images != NULL && loaded < image_count && load_server_image(image_paths[loaded], &images[loaded])){
+        ++loaded;
+    }
+    int listener = loaded == image_count ? open_socket(socket_path) : -1;
+    if (listener < 0){
+        if (loaded == image_count){
+            printf("%s: socket could not be opened\n", socket_path);
+        }
+        for (int i = 0; i < loaded; ++i) {
+            mm_destroy(&images[i].mm);
+            free(images[i].image.physical_memory);
+        }
+        free(images);
+        return -1;
+    }
+
+    struct sigaction action = { .sa_handler = on_signal };
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    printf("serving %d image(s) on %s\n", image_count, socket_path);
+    fflush(stdout);
+
+    // one thread serves every client, so requests never run concurrently on an image
+    struct client* clients = NULL;
+    struct pollfd* fds = malloc(sizeof(struct pollfd));
+    size_t client_count = 0, capacity = 0;
+    bool accepting = true; // false while accepting fails for want of descriptors or memory
+    int status = 0;
+    while (!stopping && fds != NULL){
+        fds[0] = (struct pollfd){ .fd = listener, .events = accepting ? POLLIN : 0 };
+        for (size_t i = 0; i < client_count; ++i) {
+            struct client* client = &clients[i];
+            fds[i + 1] = (struct pollfd){ .fd = client->fd };
+            fds[i + 1].events = (pending(&client->out) > 0 ? POLLOUT : 0)
+                                | (!client->closing && pending(&client->out) < OUTPUT_LIMIT ? POLLIN : 0);
+        }
+        int ready = poll(fds, client_count + 1, accepting ? -1 : ACCEPT_BACKOFF_MS);
+        if (ready < 0 && errno == EINTR){
+            continue; // stopping is checked again
+        }
+        if (ready < 0){
+            printf("%s: poll failed: %s\n", socket_path, strerror(errno));
+            status = -1;
+            break;
+        }
+        accepting |= ready == 0;
+        for (size_t i = 0; i < client_count; ++i) {
+            struct client* client = &clients[i];
+            bool alive = true;
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)){
+                alive = receive(client) && handle_requests(client, images, image_count);
+            }
+            alive = alive && flush(client) && !(client->closing && pending(&client->out) == 0);
+            if (!alive){
+                close_client(client);
+                accepting = true; // a descriptor is free again
+                clients[i] = clients[client_count - 1];
+                fds[i + 1] = fds[client_count];
+                --client_count;
+                --i;
+            }
+        }
+        if (fds[0].revents & POLLIN){
+            for (int fd; accepting;) {
+                if ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0){
+                    // the connection waits in the backlog while no descriptor or memory is left for it
+                    accepting = !(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM);
+                    if (errno == EINTR || errno == ECONNABORTED){
+                        continue;
+                    }
+                    break;
+                }
+                if (client_count == capacity){
+                    size_t grown = capacity == 0 ? 16 : capacity * 2;
+                    struct client* grown_clients = realloc(clients, grown * sizeof(struct client));
+                    clients = grown_clients != NULL ? grown_clients : clients;
+                    struct pollfd* grown_fds = realloc(fds, (grown + 1) * sizeof(struct pollfd));
+                    fds = grown_fds != NULL ? grown_fds : fds;
+                    if (grown_clients == NULL || grown_fds == NULL){
+                        close(fd);
+                        accepting = false;
+                        break;
+                    }
+                    capacity = grown;
+                }
+                clients[client_count++] = (struct client){ .fd = fd };
+            }
+        }
+    }
+
+    for (size_t i = 0; i < client_count; ++i) {
+        close_client(&clients[i]);
+    }
+    free(clients);
+    free(fds);
+    close(listener);
+    remove_socket(socket_path);
+    for (int i = 0; i < image_count; ++i) {
+        mm_destroy(&images[i].mm);
+        free(images[i].image.physical_memory);
+    }
+    free(images);
+    return status;
+}
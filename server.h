@@ -0,0 +1,54 @@
+#ifndef CHALLENGE6_SERVER_H
+#define CHALLENGE6_SERVER_H
+#include <stdint.h>
+
+// Binary protocol spoken over the Unix domain socket, in host byte order. A client sends a request header followed by
+// count entries and gets back a response header followed by count entries, in the same order. Clients may send any
+// number of requests before reading responses; each connection is answered in order. The server stops reading from a
+// connection while a few megabytes of its responses are unread, so a pipelining client has to read while it sends.
+#define MS_PROTOCOL_MAGIC 0x4d534d31u // "MSM1"
+// Largest number of entries in one request.
+#define MS_MAX_BATCH 65536
+
+enum ms_op {
+    MS_OP_TRANSLATE = 't',
+    MS_OP_READ = 'r',
+    MS_OP_WRITE = 'w'
+};
+
+enum ms_status {
+    MS_STATUS_OK,
+    MS_STATUS_BAD_MAGIC,  // the connection is closed after this one, the stream cannot be trusted any more
+    MS_STATUS_BAD_IMAGE,
+    MS_STATUS_BAD_OP,
+    MS_STATUS_TOO_LARGE   // also closes the connection
+};
+
+struct ms_request_header {
+    uint32_t magic;
+    uint32_t op;      // enum ms_op
+    uint32_t image;   // index of the image in the order they were given on the command line
+    uint32_t count;
+};
+
+struct ms_request_entry {
+    uint32_t address; // virtual address
+    int32_t value;    // value to store, ignored unless op is MS_OP_WRITE
+};
+
+struct ms_response_header {
+    uint32_t magic;
+    uint32_t status;  // enum ms_status; entries only follow MS_STATUS_OK
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct ms_response_entry {
+    int32_t fault;    // enum mm_fault; the access was done if MM_SUCCEEDED() holds
+    int32_t value;    // physical address for MS_OP_TRANSLATE, the value read or written otherwise
+};
+
+//Loads every image once and answers batched requests on a Unix domain socket at socket_path until SIGINT or SIGTERM. A socket already at socket_path is replaced, anything else there is left alone and the socket is not opened. Returns 0 on a clean shutdown and -1 if an image or the socket could not be set up or waiting for clients failed.
+extern int serve(const char* socket_path, const char** image_paths, int image_count);
+
+#endif // CHALLENGE6_SERVER_H
@@ -0,0 +1,236 @@
+#include "shards.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// murmur3 finalizer, spreads page numbers evenly over 32 bits
+static uint32_t hash_page(unsigned int page){
+    uint32_t h = page;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static unsigned int size_of(const struct shards_node* node){
+    return node == NULL ? 0 : node->size;
+}
+
+static void update_size(struct shards_node* node){
+    node->size = 1 + size_of(node->left) + size_of(node->right);
+}
+
+// treap by time: merge two treaps where every time in left is below every time in right
+static struct shards_node* merge(struct shards_node* left, struct shards_node* right){
+    if (left == NULL || right == NULL){
+        return left == NULL ? right : left;
+    }
+    if (left->priority > right->priority){
+        left->right = merge(left->right, right);
+        update_size(left);
+        return left;
+    }
+    right->left = merge(left, right->left);
+    update_size(right);
+    return right;
+}
+
+static struct shards_node* remove_time(struct shards_node* root, unsigned long long time){
+    if (root->time == time){
+        return merge(root->left, root->right);
+    }
+    if (time < root->time){
+        root->left = remove_time(root->left, time);
+    }else{
+        root->right = remove_time(root->right, time);
+    }
+    update_size(root);
+    return root;
+}
+
+// number of nodes referenced after time
+static unsigned int count_after(const struct shards_node* node, unsigned long long time){
+    unsigned int count = 0;
+    while (node != NULL){
+        if (node->time > time){
+            count += 1 + size_of(node->right);
+            node = node->left;
+        }else{
+            node = node->right;
+        }
+    }
+    return count;
+}
+
+static struct shards_node** bucket_of(const struct shards* shards, unsigned int page){
+    return &shards->table[hash_page(page ^ 0x9e3779b9u) & (shards->table_size - 1)];
+}
+
+static bool grow_table(struct shards* shards){
+    unsigned int old_size = shards->table_size;
+    struct shards_node** old_table = shards->table;
+    shards->table_size = old_size == 0 ? 64 : old_size * 2;
+    shards->table = calloc(shards->table_size, sizeof(struct shards_node*));
+    if (shards->table == NULL){
+        shards->table = old_table;
+        shards->table_size = old_size;
+        return false;
+    }
+    for (unsigned int i = 0; i < old_size; ++i) {
+        for (struct shards_node *node = old_table[i], *next; node != NULL; node = next) {
+            next = node->next;
+            struct shards_node** bucket = bucket_of(shards, node->page);
+            node->next = *bucket;
+            *bucket = node;
+        }
+    }
+    free(old_table);
+    return true;
+}
+
+static void heap_push(struct shards* shards, struct shards_node* node){
+    unsigned int i = shards->samples - 1;
+    while (i > 0 && shards->heap[(i - 1) / 2]->hash < node->hash){
+        shards->heap[i] = shards->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    shards->heap[i] = node;
+}
+
+static struct shards_node* heap_pop(struct shards* shards){
+    struct shards_node* top = shards->heap[0];
+    struct shards_node* last = shards->heap[shards->samples - 1];
+    unsigned int count = shards->samples - 1, i = 0;
+    for (unsigned int child; (child = 2 * i + 1) < count; i = child) {
+        if (child + 1 < count && shards->heap[child + 1]->hash > shards->heap[child]->hash){
+            ++child;
+        }
+        if (shards->heap[child]->hash <= last->hash){
+            break;
+        }
+        shards->heap[i] = shards->heap[child];
+    }
+    shards->heap[i] = last;
+    return top;
+}
+
+// forget the sampled page with the largest hash and sample below its hash from now on
+static void evict_largest(struct shards* shards){
+    struct shards_node* node = heap_pop(shards);
+    --shards->samples;
+    shards->root = remove_time(shards->root, node->time);
+    struct shards_node** link = bucket_of(shards, node->page);
+    while (*link != node){
+        link = &(*link)->next;
+    }
+    *link = node->next;
+    if (node->hash < shards->threshold){
+        // the histogram was counted at the old rate, bring it down to the new one
+        double rate = node->hash / 4294967296.0;
+        for (int b = 0; b < SHARDS_BUCKETS; ++b) {
+            shards->histogram[b] *= rate / shards->rate;
+        }
+        shards->threshold = node->hash;
+        shards->rate = rate;
+    }
+    free(node);
+}
+
+bool shards_init(struct shards* shards, double rate, unsigned int max_samples){
+    *shards = (struct shards){
+        .threshold = (uint64_t) (rate * 4294967296.0),
+        .rate = rate,
+        .max_samples = max_samples,
+        .seed = 0x2545f491u,
+    };
+    if (!(rate > 0 && rate <= 1) || !grow_table(shards)){
+        return false;
+    }
+    if (max_samples != 0){
+        shards->heap = malloc((max_samples + 1) * sizeof(struct shards_node*));
+        if (shards->heap == NULL){
+            shards_destroy(shards);
+            return false;
+        }
+    }
+    return true;
+}
+
+void shards_destroy(struct shards* shards){
+    for (unsigned int i = 0; i < shards->table_size; ++i) {
+        for (struct shards_node *node = shards->table[i], *next; node != NULL; node = next) {
+            next = node->next;
+            free(node);
+        }
+    }
+    free(shards->table);
+    free(shards->heap);
+    shards->table = NULL;
+    shards->heap = NULL;
+}
+
+unsigned int shards_samples_for_error(double error){
+    double samples = 1 / (error * error);
+    return (unsigned int) samples + ((unsigned int) samples < samples);
+}
+
+void shards_access(struct shards* shards, unsigned int page){
+    ++shards->references;
+    uint32_t hash = hash_page(page);
+    if (hash >= shards->threshold){
+        return;
+    }
+    ++shards->clock;
+    struct shards_node** bucket = bucket_of(shards, page);
+    struct shards_node* node = *bucket;
+    while (node != NULL && node->page != page){
+        node = node->next;
+    }
+    if (node != NULL){
+        // scale the distance among sampled pages up to all pages
+        unsigned long long distance = (unsigned long long) (count_after(shards->root, node->time) / shards->rate);
+        int b = distance == 0 ? 0 : 64 - __builtin_clzll(distance);
+        shards->histogram[b < SHARDS_COLD ? b : SHARDS_COLD - 1] += 1;
+        shards->root = remove_time(shards->root, node->time);
+    }else{
+        shards->histogram[SHARDS_COLD] += 1;
+        if (shards->samples + 1 > shards->table_size){
+            grow_table(shards);
+            bucket = bucket_of(shards, page);
+        }
+        node = malloc(sizeof(struct shards_node));
+        if (node == NULL){
+            return;
+        }
+        *node = (struct shards_node){ .page = page, .hash = hash, .next = *bucket };
+        *bucket = node;
+        ++shards->samples;
+        if (shards->max_samples != 0){
+            heap_push(shards, node);
+        }
+    }
+    // the newest reference always goes to the right end of the treap
+    shards->seed ^= shards->seed << 13;
+    shards->seed ^= shards->seed >> 17;
+    shards->seed ^= shards->seed << 5;
+    *node = (struct shards_node){ .page = node->page, .hash = node->hash, .priority = shards->seed, .size = 1,
+                                  .time = shards->clock, .next = node->next };
+    shards->root = merge(shards->root, node);
+    while (shards->max_samples != 0 && shards->samples > shards->max_samples){
+        evict_largest(shards);
+    }
+}
+
+double shards_miss_ratio(const struct shards* shards, unsigned int order){
+    // references expected at the current rate; the difference to what was counted goes to distance 0 (SHARDS-adj)
+    double expected = shards->references * shards->rate, misses = 0;
+    for (unsigned int b = order + 1; b < SHARDS_BUCKETS; ++b) {
+        misses += shards->histogram[b];
+    }
+    if (expected <= 0){
+        return 0;
+    }
+    return misses >= expected ? 1 : misses / expected;
+}
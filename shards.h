@@ -0,0 +1,58 @@
+#ifndef CHALLENGE6_SHARDS_H
+#define CHALLENGE6_SHARDS_H
+#include <stdbool.h>
+#include <stdint.h>
+
+// Reuse distances are counted in power-of-two buckets: bucket 0 holds distance 0 and bucket k the distances from
+// 2^(k-1) up to 2^k - 1. The last bucket holds first references, which miss at every size.
+#define SHARDS_BUCKETS 34
+#define SHARDS_COLD (SHARDS_BUCKETS - 1)
+
+// A sampled page. Nodes form a treap ordered by the time of the last reference, so the reuse distance of a page is the
+// number of nodes referenced after it, and are chained into a hash table by page.
+struct shards_node {
+    unsigned int page;
+    uint32_t hash;
+    uint32_t priority;
+    unsigned int size;
+    unsigned long long time;
+    struct shards_node* left;
+    struct shards_node* right;
+    struct shards_node* next;
+};
+
+// Spatially sampled reuse distance analysis (SHARDS). A page is followed only when the hash of its number falls under
+// threshold, so roughly rate of all pages are, and measured distances are divided by rate. With max_samples set the
+// sample set has a fixed size: when it is full the page with the largest hash is dropped and the threshold lowered
+// to that hash, which keeps memory constant however many pages the trace touches.
+struct shards {
+    uint64_t threshold;             // out of 2^32
+    double rate;
+    unsigned int max_samples;       // 0 for a fixed rate
+    unsigned int samples;
+    struct shards_node* root;
+    struct shards_node** table;
+    unsigned int table_size;
+    struct shards_node** heap;      // max-heap by hash, only with max_samples
+    uint32_t seed;
+    unsigned long long clock;
+    unsigned long long references;  // all references, sampled or not
+    double histogram[SHARDS_BUCKETS];
+};
+
+//Sets up a fixed rate analysis (max_samples 0) or a fixed size one that starts at the given rate. Returns false for a rate outside (0, 1] or if memory could not be allocated.
+extern bool shards_init(struct shards* shards, double rate, unsigned int max_samples);
+
+//Releases every node and table held by the analysis.
+extern void shards_destroy(struct shards* shards);
+
+//Number of samples a fixed size analysis needs so the miss ratios are off by about error at most. The error of a sampled ratio shrinks with one over the square root of the samples.
+extern unsigned int shards_samples_for_error(double error);
+
+//Records a reference to the page.
+extern void shards_access(struct shards* shards, unsigned int page);
+
+//Estimated miss ratio of an LRU memory holding 2^order pages.
+extern double shards_miss_ratio(const struct shards* shards, unsigned int order);
+
+#endif // CHALLENGE6_SHARDS_H
@@ -7,86 +7,644 @@
 #include <stdbool.h>
 #include <string.h>
 #include <malloc.h>
-#include <math.h>
 
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include "diff.h"
+#include "kernels.h"
+#include "ksm.h"
 #include "memsim.h"
+#include "mm.h"
+#include "parse.h"
+#include "ptstat.h"
+#include "server.h"
+#include "trace.h"
+#include "zswap.h"
 
 
+// everything a command needs while the simulator runs
+struct session {
+    struct address_space mm;
+    struct translation_cache tlb;
+    struct shards shards;
+    struct ksm ksm;
+    struct zswap zswap;
+    struct wss wss;
+    struct ptstat ptstat;
+    unsigned int mergePages; // pages scanned for merging before every command, 0 when merging is off
+    int offsetBits;
+};
+
+static void print_frames(const struct buddy_allocator* frames){
+    int largest = buddy_largest_free_order(frames);
+    printf("free frames: %u/%u, largest free block: %d frames\n",
+           frames->free_frames, frames->num_frames, largest < 0 ? 0 : 1 << largest);
+    for (unsigned int o = 0; o <= frames->max_order; ++o) {
+        printf("order %2u: %u blocks, %u frames\n", o, frames->free_blocks[o], frames->free_blocks[o] << o);
+    }
+    printf("allocations: %llu, failed: %llu, failed from fragmentation: %llu\n",
+           frames->alloc_requests, frames->alloc_failures, frames->fragmentation_failures);
+}
+
+static void print_mappings(struct address_space* mm){
+    for (unsigned int a = 0; a < mm->words_virtual;) {
+        struct vma* area = vma_first_overlap(&mm->vmas, a, mm->words_virtual);
+        if (area == NULL){
+            break;
+        }
+        printf("%u-%u %c%c\n", area->start, area->end,
+               area->prot & VMA_READ ? 'r' : '-', area->prot & VMA_WRITE ? 'w' : '-');
+        a = area->end;
+    }
+    printf("page table frames in use: %u/%u, emptied: %llu times\n", mm->pt_frames_live, mm->pt_frames,
+           mm->pt_frames_emptied);
+    printf("faults: %llu lazy, %llu copy-on-write, %llu swap-in, %llu protection, %llu segmentation, %llu out of "
+           "memory\n", mm->faults[MM_FAULT_LAZY], mm->faults[MM_FAULT_COW], mm->faults[MM_FAULT_SWAP],
+           mm->faults[MM_FAULT_PROTECTION], mm->faults[MM_FAULT_SEGV],
+           mm->faults[MM_FAULT_OOM]);
+    printf("vma cache: %llu hits, %llu misses\n", mm->vma_cache_hits, mm->vma_cache_misses);
+}
+
+static void print_translation_stats(const struct translation_cache* tlb){
+    // coverage: misses the prefetch buffer took over from a walk, accuracy: prefetched pages that were used
+    unsigned long long walks = tlb->demand_walks + tlb->prefetch_walks;
+    printf("translations: %llu, hits: %llu, misses: %llu\n", tlb->accesses, tlb->hits, tlb->misses);
+    printf("prefetched: %llu, buffer hits: %llu, coverage: %.1f%%, accuracy: %.1f%%\n", tlb->prefetches,
+           tlb->buffer_hits, tlb->misses ? 100.0 * tlb->buffer_hits / tlb->misses : 0.0,
+           tlb->prefetches ? 100.0 * tlb->buffer_hits / tlb->prefetches : 0.0);
+    printf("walks: %llu demand, %llu prefetch (%.1f%% of all walks)\n", tlb->demand_walks, tlb->prefetch_walks,
+           walks ? 100.0 * tlb->prefetch_walks / walks : 0.0);
+}
+
+static void print_miss_ratio_curve(const struct shards* shards){
+    printf("references: %llu, sampled pages: %u, sampling rate: %g\n", shards->references, shards->samples,
+           shards->rate);
+    // sizes below one over the rate cannot be told apart by the sample
+    for (unsigned int order = 0; order < SHARDS_COLD - 1; ++order) {
+        if ((double) (1ull << order) * shards->rate >= 1) {
+            printf("%10llu pages: %.4f\n", 1ull << order, shards_miss_ratio(shards, order));
+        }
+        if (shards_miss_ratio(shards, order) == shards_miss_ratio(shards, SHARDS_COLD - 2)) {
+            break;
+        }
+    }
+}
+
+static void print_merging(const struct ksm* ksm){
+    unsigned int sharing = ksm_pages_sharing(ksm);
+    // each shared frame takes the place of one of the frames its pages had; one no page maps any more costs a frame
+    // until the pass that lets go of it
+    int saved = (int) sharing - (int) ksm->stable_frames;
+    unsigned long long unmerges = ksm->mm->faults[MM_FAULT_COW];
+    printf("shared frames: %u, pages sharing them: %u, saved: %d frames (%d words)\n", ksm->stable_frames, sharing,
+           saved, saved * (int) ksm->mm->frame_words);
+    printf("passes: %llu, scan cost: %.0f ns per pass, %.1f ns per page\n", ksm->passes,
+           ksm->passes ? (double) ksm->scan_ns / ksm->passes : 0.0,
+           ksm->passes ? (double) ksm->scan_ns / ((double) ksm->passes * ksm->mm->num_pages) : 0.0);
+    printf("merged: %llu, unmerged by writes: %llu (%.1f%%)\n", ksm->merges, unmerges,
+           ksm->merges ? 100.0 * unmerges / ksm->merges : 0.0);
+}
+
+static void print_compression(const struct zswap* zswap){
+    // ratio: what the pooled pages would take whole over the frames holding them, capacity: pages held by the tier
+    // in physical memory beyond the frames it uses
+    unsigned long long pooled = (unsigned long long) zswap->pooled_pages * zswap->frame_bytes;
+    unsigned int held = zswap->same_filled_pages + zswap->pooled_pages;
+    printf("evicted: %llu, in the tier: %u same filled, %u compressed, %u in swap\n", zswap->mm->evictions,
+           zswap->same_filled_pages, zswap->pooled_pages, zswap->swapped_pages);
+    printf("pool: %u/%u frames, %llu bytes compressed, ratio %.2f (%.2f counting unused slot space)\n",
+           zswap->pool_frames, zswap->max_pool_frames, zswap->pooled_bytes,
+           zswap->pooled_bytes ? (double) pooled / zswap->pooled_bytes : 0.0,
+           zswap->pool_frames ? (double) pooled / ((double) zswap->pool_frames * zswap->frame_bytes) : 0.0);
+    printf("capacity gained: %d frames (%.1f%% of physical memory)\n", (int) held - (int) zswap->pool_frames,
+           100.0 * ((int) held - (int) zswap->pool_frames) / zswap->mm->frames.num_frames);
+    printf("sent to swap: %llu incompressible, %llu with the pool full\n", zswap->incompressible, zswap->pool_full);
+    printf("compress: %llu, %.0f ns each, decompress: %llu, %.0f ns each\n", zswap->compressions,
+           zswap->compressions ? (double) zswap->compress_ns / zswap->compressions : 0.0, zswap->decompressions,
+           zswap->decompressions ? (double) zswap->decompress_ns / zswap->decompressions : 0.0);
+}
+
+static void print_working_set(const struct wss* wss){
+    printf("accesses: %llu, pages touched: %u/%u\n", wss->time, wss->touched, wss->num_pages);
+    for (unsigned int k = 0; k < wss->windows; ++k) {
+        printf("WS(%llu): %u pages\n", wss->window[k], wss->size[k]);
+    }
+    // idle ages in accesses since each page was last used
+    unsigned int ages[WSS_AGE_BUCKETS];
+    unsigned int untouched = wss_idle_ages(wss, ages);
+    printf("never used: %u pages\n", untouched);
+    for (unsigned int b = 0; b < WSS_AGE_BUCKETS; ++b) {
+        if (ages[b] != 0) {
+            printf("idle %10llu-%llu: %u pages\n", b == 0 ? 0 : 1ull << (b - 1), b == 0 ? 0 : (1ull << b) - 1,
+                   ages[b]);
+        }
+    }
+}
+
+static void print_page_table(const struct ptstat* ptstat){
+    struct ptstat_report report;
+    if (!ptstat_analyze(ptstat, &report)) {
+        printf("not enough memory for the analysis\n");
+        return;
+    }
+    const char* DENSITY[PTSTAT_DENSITY_BUCKETS] = {"empty", "1-25%", "26-50%", "51-75%", "76-99%", "full"};
+    printf("page table: %u frames at word %u, %u words past a line boundary\n", report.table_frames,
+           ptstat->page_table_loc, ptstat->page_table_loc % PTSTAT_LINE_WORDS);
+    printf("entries in use: %u/%u (%.1f%%)\n", report.used_entries, ptstat->num_pages,
+           100.0 * report.used_entries / ptstat->num_pages);
+    printf("table frames by entries in use:");
+    for (unsigned int b = 0; b < PTSTAT_DENSITY_BUCKETS; ++b) {
+        printf(" %s %u%s", DENSITY[b], report.density[b], b + 1 < PTSTAT_DENSITY_BUCKETS ? "," : "\n");
+    }
+    if (ptstat->walks != NULL) {
+        printf("walks: %llu, replaying the last %llu through a %u line LRU cache\n", ptstat->total_walks,
+               report.walks, PTSTAT_CACHE_LINES);
+    }
+    // overhead: frames each layout takes against the frames of the pages it maps
+    for (unsigned int l = 0; l < PTSTAT_LAYOUTS; ++l) {
+        const struct ptstat_layout_report* layout = &report.layouts[l];
+        printf("%-15s %6u frames (%5.1f%% of the pages in use)", ptstat_layout_name(l), layout->frames,
+               report.used_entries ? 100.0 * layout->frames / report.used_entries : 0.0);
+        if (ptstat->walks != NULL) {
+            printf(", %.2f lines per walk, %u lines touched, %llu misses (%.1f%%)",
+                   report.walks ? (double) layout->line_accesses / report.walks : 0.0, layout->lines,
+                   layout->misses, layout->line_accesses ? 100.0 * layout->misses / layout->line_accesses : 0.0);
+        }
+        printf("\n");
+    }
+}
+
+// parse the -W argument, a comma separated list of window sizes
+static bool init_working_set(struct wss* wss, unsigned int num_pages, const char* spec, FILE* series){
+    unsigned long long windows[WSS_MAX_WINDOWS];
+    unsigned int count = 0;
+    for (char* end;; spec = end + 1) {
+        if (count == WSS_MAX_WINDOWS) {
+            return false;
+        }
+        windows[count++] = strtoull(spec, &end, 10);
+        if (end == spec || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        if (*end == '\0') {
+            break;
+        }
+    }
+    // one row per smallest window keeps every window's changes visible
+    unsigned long long interval = windows[0];
+    for (unsigned int k = 1; k < count; ++k) {
+        interval = windows[k] < interval ? windows[k] : interval;
+    }
+    return wss_init(wss, num_pages, windows, count, series, interval);
+}
+
+static void print_diff_output(const char* side, const struct diff_output* output,
+                              const struct trace_command* commands){
+    const struct trace_command* command = &commands[output->command];
+    printf("  %s line %u: %c %d", side, command->line, command->op, command->args[0]);
+    if (command->op == 'w') {
+        printf(" %d", command->args[1]);
+    }
+    if (output->fault) {
+        printf(" -> fault\n");
+    }else if (command->op == 't') {
+        printf(" -> %u\n", output->physical_address);
+    }else{
+        printf(" -> %u: %d\n", output->physical_address, output->value);
+    }
+}
+
+static void print_diff_report(const struct diff_report* report, const char* backend,
+                              const struct trace_command* commands){
+    printf("replayed %zu operations against %s (%zu other commands skipped): %s\n", report->operations, backend,
+           report->skipped, report->result == DIFF_SAME ? "same" : "diverged");
+    printf("reference: %.1f ns per operation, %s: %.1f ns per operation, full memory checks: %zu\n",
+           report->operations ? (double) report->reference_ns / report->operations : 0.0, backend,
+           report->operations ? (double) report->candidate_ns / report->operations : 0.0, report->full_checks);
+    printf("output digest: %016llx, memory hash: %016llx\n", (unsigned long long) report->output_digest,
+           (unsigned long long) report->memory_hash);
+    if (report->result == DIFF_OUTPUT) {
+        printf("first divergence:\n");
+        print_diff_output("reference", &report->reference, commands);
+        print_diff_output(backend, &report->candidate, commands);
+        printf("  page table entry: reference %#x, %s %#x\n", (unsigned int) report->reference_entry, backend,
+               (unsigned int) report->candidate_entry);
+    }else if (report->result == DIFF_MEMORY) {
+        printf("memories differ at word %u: reference %d, %s %d\n", report->word, report->reference_word, backend,
+               report->candidate_word);
+        printf("  they were the same up to line %u, the difference comes from the commands after it\n",
+               report->equal_through == 0 ? 0 : commands[report->equal_through - 1].line);
+    }
+    if (report->result == DIFF_OUTPUT || report->result == DIFF_MEMORY) {
+        printf("last outputs both agreed on:\n");
+        for (unsigned int i = 0; i < report->context_count; ++i) {
+            print_diff_output("", &report->context[i], commands);
+        }
+    }
+}
+
+// parse the -S argument: rate=<fraction>, samples=<count> or error=<bound>
+static bool init_shards(struct shards* shards, const char* spec){
+    double number;
+    if (sscanf(spec, "rate=%lf", &number) == 1) {
+        return shards_init(shards, number, 0);
+    }else if (sscanf(spec, "samples=%lf", &number) == 1 && number >= 1) {
+        return shards_init(shards, 1, (unsigned int) number);
+    }else if (sscanf(spec, "error=%lf", &number) == 1 && number > 0 && number < 1) {
+        return shards_init(shards, 1, shards_samples_for_error(number));
+    }
+    return false;
+}
+
+// run one command typed at the prompt or read from a trace. Returns false on q.
+static bool run_command(struct session* session, const struct trace_command* command){
+    const char* HELP = "%15s t <virtual_address>\n%15s r <virtual_address>\n%15s w <virtual_address>\n%15s f\n"
+                       "%15s m <virtual_address> <length> <prot>\n%15s u <virtual_address> <length>\n"
+                       "%15s p <virtual_address> <length> <prot>\n%15s b <virtual_address>\n%15s v\n%15s s\n%15s c\n%15s k\n"
+                       "%15s z\n%15s i\n%15s l\n"
+                       "(prot: 1 read, 2 write, 3 read/write)\n";
+    const char* FAULTS[MM_FAULT_TYPES] = {"", "", "", "", "protection violation", "segmentation fault",
+                                          "out of memory"};
+    struct address_space* mm = &session->mm;
+    int addr = command->args[0], value = command->args[1], length = command->args[1], prot = command->args[2];
+
+    // merging runs in the background, a few pages at a time between commands
+    if (session->mergePages != 0) {
+        ksm_scan(&session->ksm, session->mergePages);
+    }
+
+    if(command->op == 'h') {
+        printf( HELP, "Address translation:", "Read from memory:", "Write to memory:", "Frame usage:", "Map:",
+                "Unmap:", "Protect:", "Set break:", "Mappings:", "Translation stats:", "Miss ratio curve:", "Page merging:",
+                "Compression:", "Working set:", "Page table:");
+        return true;
+    }else if(command->op == 'q'){
+        return false;
+    }else if(command->op == 'f'){
+        print_frames(&mm->frames);
+        return true;
+    }else if(command->op == 'v'){
+        print_mappings(mm);
+        return true;
+    }else if(command->op == 's'){
+        print_translation_stats(&session->tlb);
+        return true;
+    }else if(command->op == 'c'){
+        if (session->mm.shards != NULL) {
+            print_miss_ratio_curve(session->mm.shards);
+        }else{
+            printf("no miss ratio analysis, start with -S\n");
+        }
+        return true;
+    }else if(command->op == 'k'){
+        if (session->mergePages != 0) {
+            print_merging(&session->ksm);
+        }else{
+            printf("no page merging, start with -K\n");
+        }
+        return true;
+    }else if(command->op == 'z'){
+        if (mm->zswap != NULL) {
+            print_compression(mm->zswap);
+        }else{
+            printf("no compressed tier, start with -Z\n");
+        }
+        return true;
+    }else if(command->op == 'i'){
+        if (mm->wss != NULL) {
+            print_working_set(mm->wss);
+        }else{
+            printf("no working set tracking, start with -W\n");
+        }
+        return true;
+    }else if(command->op == 'l'){
+        print_page_table(&session->ptstat);
+        return true;
+    }else if (command->op == 'm' || command->op == 'p') {
+        bool ok = command->op == 'm' ? mm_mmap(mm, addr, length, prot) : mm_mprotect(mm, addr, length, prot);
+        printf("%d-%d: %s\n", addr, addr + length, ok ? "ok" : "invalid range");
+        return true;
+    }else if (command->op == 'u') {
+        printf("%d-%d: %s\n", addr, addr + length, mm_munmap(mm, addr, length) ? "ok" : "invalid range");
+        return true;
+    }else if (command->op == 'b') {
+        bool ok = mm_brk(mm, addr);
+        printf("break: %u%s\n", mm->brk, ok ? "" : " (unchanged)");
+        return true;
+    }
+
+    unsigned int p_addr;
+    enum mm_fault fault = mm_access(mm, addr, command->op == 'w' ? VMA_WRITE : VMA_READ, &p_addr);
+    if (!MM_SUCCEEDED(fault)) {
+        printf("%d: %s\n", addr, FAULTS[fault]);
+    }else if (command->op == 't') {
+        printf("%d -> %d\n", addr, p_addr);
+    }else if (command->op == 'r') {
+        printf("%d: %d\n", addr, read_value(p_addr, session->offsetBits, mm->page_table_loc, mm->physical_memory));
+    }else if (command->op == 'w') {
+        printf("%d: %d\n", addr, value);
+        write_value(value, p_addr, session->offsetBits, mm->page_table_loc, mm->physical_memory);
+    }
+    return true;
+}
+
 int main(const int argc, const char** argv){
-    int
-        wordsVirtual,
-        wordsPhysical,
-        frameWords,
-        pageTableLocation,
-        addr,
-        value;
     char command = ' ';
     const char* FERROR = "File could not be read. Try again";
-    const char* HELP = "%15s t <virtual_address>\n%15s r <virtual_address>\n%15s w <virtual_address>\n";
+    const char* USAGE = "Usage: %s [-P none|sequential|stride|distance] [-S rate=<r>|samples=<n>|error=<e>] [-K pages] "
+                        "[-Z max_pool_percent] [-W window,...] [-o series.csv] [-L walks] [-T log[:period[:slow]]] [-r trace] "
+                        "<mem_file>\n"
+                        "       %s -D translate|kernel|mm[:chunk[:check_interval]] -r trace <mem_file>\n"
+                        "       %s -B repetitions -r trace <mem_file>\n"
+                        "       %s -d <socket> <mem_file>...\n";
     const char* WELCOME = "Welcome to the Paged Memory Simulator\n";
     // end initial declarations //
 
-    FILE *stream;
-    stream = fopen(argv[1], "r");
+    // options: -P picks the translation prefetcher, -S turns on the sampled miss ratio curve, -r replays a trace file
+    // instead of reading commands from stdin, -K merges identical pages scanning that many pages per command, -Z evicts
+    // pages to a compressed tier when memory runs out, -W tracks the working set over the given windows and -o writes
+    // it out as it changes, -L keeps that many page table walks for the layout analysis, -T logs one in period events
+    // (only slow path ones with slow) to a binary file for tracedump, -D checks a translation backend against the
+    // reference path on the trace, -B times the replay kernels on it, -d serves every image given over a socket instead
+    enum tlb_prefetcher prefetcher = TLB_PREFETCH_NONE;
+    const char* tracePath = NULL;
+    const char* shardsSpec = NULL;
+    const char* socketPath = NULL;
+    int mergePages = 0;
+    int maxPoolPercent = -1;
+    const char* windowSpec = NULL;
+    const char* seriesPath = NULL;
+    const char* diffSpec = NULL;
+    int benchmarkRepetitions = 0;
+    int walkHistory = 0;
+    const char* traceSpec = NULL;
+    for (int opt; (opt = getopt(argc, (char* const*) argv, "P:S:K:Z:W:o:L:T:D:B:r:d:")) != -1;) {
+        if (opt == 'P' && (prefetcher = tlb_prefetcher_from_name(optarg)) != TLB_PREFETCHERS) {
+            continue;
+        }else if (opt == 'r') {
+            tracePath = optarg;
+            continue;
+        }else if (opt == 'S') {
+            shardsSpec = optarg;
+            continue;
+        }else if (opt == 'K' && (mergePages = atoi(optarg)) > 0) {
+            continue;
+        }else if (opt == 'Z' && (maxPoolPercent = atoi(optarg)) >= 0 && maxPoolPercent <= 100) {
+            continue;
+        }else if (opt == 'W') {
+            windowSpec = optarg;
+            continue;
+        }else if (opt == 'o') {
+            seriesPath = optarg;
+            continue;
+        }else if (opt == 'L' && (walkHistory = atoi(optarg)) > 0) {
+            continue;
+        }else if (opt == 'T') {
+            traceSpec = optarg;
+            continue;
+        }else if (opt == 'D') {
+            diffSpec = optarg;
+            continue;
+        }else if (opt == 'B' && (benchmarkRepetitions = atoi(optarg)) > 0) {
+            continue;
+        }else if (opt == 'd') {
+            socketPath = optarg;
+            continue;
+        }
+        printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+        return -1;
+    }
+    if (optind >= argc || (seriesPath != NULL && windowSpec == NULL) || (diffSpec != NULL && tracePath == NULL)
+        || (benchmarkRepetitions > 0 && tracePath == NULL)) {
+        printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+        return -1;
+    }
+    if (socketPath != NULL) {
+        return serve(socketPath, argv + optind, argc - optind);
+    }
+
+    // load the image, with an error message pointing at the offending line if it cannot be verified
+    struct memsim_image image;
+    struct parse_error error;
+    if(!load_image(argv[optind], &image, &error)){
+        printf("%s\n%s:%lu:%lu: %s\n", FERROR, argv[optind], error.line, error.column, error.message);
+        return -1;
+    }
+    const int wordsVirtual = image.words_virtual, frameWords = image.frame_words;
 
-    // get first four values from file
-    fscanf(stream, "%d\n%d\n%d\n%d", &wordsVirtual, &wordsPhysical, &frameWords, &pageTableLocation);
+    // from here on every way out goes through done, which releases what was set up so far
+    struct session session = { .offsetBits = __builtin_ctz(frameWords) };
+    int status = 0;
+    bool mmReady = false;
+    FILE* series = NULL;
+    struct tracer tracer;
+
+    // decode the whole trace up front so a bad line is reported before anything runs
+    struct trace_command* trace = NULL;
+    size_t traceLength = 0;
+    if(tracePath != NULL && !load_commands(tracePath, &trace, &traceLength, &error)){
+        printf("%s\n%s:%lu:%lu: %s\n", FERROR, tracePath, error.line, error.column, error.message);
+        status = -1;
+        goto done;
+    }
 
-    // Early return and error message if the first four values cannot be verified.
-    if(!file_verification(wordsVirtual, wordsPhysical, frameWords, pageTableLocation)){
+    // the mem_files hold frame addresses in the page table, turn them into page table entries
+    if(!convert_legacy_page_table(image.page_table_loc, wordsVirtual / frameWords, frameWords, image.words_physical,
+                                  image.physical_memory)){
         printf("%s", FERROR);
-        return -1;
+        status = -1;
+        goto done;
     }
 
-    // initialize consts for the number of bits used for the offset and the number of pages and frames needed to fit all
-    // virtual memory words into physical memory
-    const int offsetBits = (int) log2(frameWords); // number of bits used for offset
-    const int numPages = wordsVirtual / frameWords; // number of pages
+    // replay the trace through the reference path and a backend side by side instead of running it; a full memory
+    // check every words_physical operations costs about a word per operation
+    if (diffSpec != NULL) {
+        char name[32];
+        size_t chunk = 4096, checkInterval = image.words_physical < 65536 ? 65536 : image.words_physical;
+        const struct diff_backend* backend = NULL;
+        if (sscanf(diffSpec, "%31[^:]:%zu:%zu", name, &chunk, &checkInterval) < 1
+            || (backend = diff_backend_from_name(name)) == NULL) {
+            printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+            status = -1;
+            goto done;
+        }
+        struct diff_report report;
+        bool same = diff_replay(&image, backend, trace, traceLength, chunk, checkInterval, &report);
+        if (report.result == DIFF_FAILED) {
+            printf("%s", FERROR);
+        }else{
+            print_diff_report(&report, backend->name, trace);
+        }
+        status = same ? 0 : 1;
+        goto done;
+    }
 
-    // initialize an array with a capacity equal to the size of the physical memory indicated in the file
-    int* physical_memory = malloc( sizeof(int[wordsPhysical]));
+    // time the replay kernels on the trace instead of running it
+    if (benchmarkRepetitions > 0) {
+        struct kernel_benchmark benchmark;
+        if (!kernel_benchmark(&image, trace, traceLength, benchmarkRepetitions, &benchmark)) {
+            printf("%s", FERROR);
+            status = -1;
+            goto done;
+        }
+        printf("operations: %llu, best of %d runs\n", benchmark.operations, benchmarkRepetitions);
+        printf("generic kernel: %.2f ns per operation\n", benchmark.generic_ns);
+        if (benchmark.specialized->offset_bits != 0) {
+            printf("kernel for %u offset bits: %.2f ns per operation (%.2fx)\n", benchmark.specialized->offset_bits,
+                   benchmark.specialized_ns,
+                   benchmark.specialized_ns > 0 ? benchmark.generic_ns / benchmark.specialized_ns : 0.0);
+        }else{
+            printf("no kernel for %d word pages, the generic one is used\n", frameWords);
+        }
+        printf("results: %s\n", benchmark.same ? "same" : "different");
+        status = benchmark.same ? 0 : 1;
+        goto done;
+    }
 
-    // populate the array
-    for (int i = 0, k; i < frameWords + numPages; ++i) {
-        fscanf(stream, "%d", &k);
-        physical_memory[i] = k;
+    // set up the address space, which takes out the frames already holding the page table and the mapped pages
+    if(!mm_init(&session.mm, image.physical_memory, wordsVirtual, image.words_physical, frameWords,
+                image.page_table_loc)){
+        printf("%s", FERROR);
+        status = -1;
+        goto done;
     }
+    mmReady = true;
 
-    // print welcome message
-    printf("%s", WELCOME);
+    // model a 16 entry translation cache with an 8 entry prefetch buffer next to it
+    if(!tlb_init(&session.tlb, 16, 8, prefetcher, image.physical_memory, image.page_table_loc,
+                 wordsVirtual / frameWords)){
+        printf("%s", FERROR);
+        status = -1;
+        goto done;
+    }
+    session.mm.tlb = &session.tlb;
 
-    // begin CLI
-    while (true){ // Checking in loop for q to avoid executing a full loop on sentinel input.
-        printf(">");
-        scanf(" %c", &command); // consume whitespace and first argument
+    // analyze the page table on request, replaying the walks the translation cache made when they are kept
+    if(!ptstat_init(&session.ptstat, image.physical_memory, image.page_table_loc, wordsVirtual / frameWords,
+                    frameWords, walkHistory)){
+        printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+        status = -1;
+        goto done;
+    }
+    if (walkHistory > 0) {
+        session.tlb.ptstat = &session.ptstat;
+    }
 
-        if(command == 'h') {
-            printf( HELP, "Address translation:", "Read from memory:", "Write to memory:");
-            continue;
-        }else if(command == 'q'){
-            break;
+    // follow a sample of the pages for the miss ratio curve
+    if (shardsSpec != NULL) {
+        if (!init_shards(&session.shards, shardsSpec)) {
+            printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+            status = -1;
+            goto done;
+        }
+        session.mm.shards = &session.shards;
+    }
+
+    // evict to a compressed tier instead of failing when no frame is left
+    if (maxPoolPercent >= 0) {
+        if (!zswap_init(&session.zswap, &session.mm, maxPoolPercent)) {
+            printf("%s", FERROR);
+            status = -1;
+            goto done;
+        }
+        session.mm.zswap = &session.zswap;
+    }
+
+    // follow the working set, writing its sizes out as they change when asked to
+    if (windowSpec != NULL) {
+        if (seriesPath != NULL && (series = fopen(seriesPath, "w")) == NULL) {
+            printf("%s could not be opened\n", seriesPath);
+            status = -1;
+            goto done;
         }
+        if (!init_working_set(&session.wss, wordsVirtual / frameWords, windowSpec, series)) {
+            printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+            status = -1;
+            goto done;
+        }
+        session.mm.wss = &session.wss;
+    }
 
-        // parse second command
-        scanf("%d", &addr); // consume second operand when it is likely there is a second argument
-        unsigned int p_addr = get_physical_address(addr, offsetBits, pageTableLocation, physical_memory);
-        if (command == 't') {
-            printf("%d -> %d\n", addr, p_addr);
-        }else if (command == 'r') {
-            printf("%d: %d\n", addr, read_value(p_addr, offsetBits, pageTableLocation, physical_memory));
-        }else if (command == 'w') {
-            // no longer checking if an address is in the page table, since all virtual addresses map to frames
-            // outside the page table. (a virtual address can never address a page table entry)
-            scanf("%d", &value); // get third arg, since we know there should be a third arg
-            printf("%d: %d\n", addr, value);
-            write_value(value, p_addr, offsetBits, pageTableLocation, physical_memory);
+    // log translation events, sampled, through a background thread
+    if (traceSpec != NULL) {
+        char logPath[256], slow[5] = "";
+        unsigned int period = 1;
+        if (sscanf(traceSpec, "%255[^:]:%u:%4s", logPath, &period, slow) < 1 || (*slow && strcmp(slow, "slow") != 0)) {
+            printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+            status = -1;
+            goto done;
         }
+        if (!trace_open(&tracer, logPath, *slow ? TRACE_SAMPLE_SLOW_PATH : TRACE_SAMPLE_ALL, period)) {
+            printf("%s could not be opened\n", logPath);
+            status = -1;
+            goto done;
+        }
+        session.mm.tracer = &tracer;
     }
+
+    // scan for identical pages between commands
+    if (mergePages > 0) {
+        if (!ksm_init(&session.ksm, &session.mm)) {
+            printf("%s", FERROR);
+            status = -1;
+            goto done;
+        }
+        session.mergePages = mergePages;
+    }
+
+    if (trace != NULL) {
+        for (size_t i = 0; i < traceLength && run_command(&session, &trace[i]); ++i) {
+        }
+    }else{
+        // print welcome message
+        printf("%s", WELCOME);
+
+        // begin CLI
+        while (true){ // Checking in loop for q to avoid executing a full loop on sentinel input.
+            printf(">");
+            if(scanf(" %c", &command) != 1){ // consume whitespace and first argument, end of input acts like q
+                break;
+            }
+            // consume as many operands as the command takes
+            struct trace_command typed = { .op = command };
+            int operands = command_arguments(command);
+            for (int i = 0; i < operands; ++i) {
+                scanf("%d", &typed.args[i]);
+            }
+            if (operands >= 0 && !run_command(&session, &typed)) {
+                break;
+            }
+        }
+    }
+done:
     // free heap allocated memory
-    free(physical_memory);
-    fclose(stream);
-    return 0;
+    if (session.mm.shards != NULL) {
+        shards_destroy(&session.shards);
+    }
+    if (session.mergePages != 0) {
+        ksm_destroy(&session.ksm);
+    }
+    if (session.mm.zswap != NULL) {
+        zswap_destroy(&session.zswap);
+    }
+    if (session.mm.wss != NULL) {
+        wss_destroy(&session.wss);
+    }
+    if (series != NULL) {
+        fclose(series);
+    }
+    if (session.mm.tracer != NULL) {
+        bool written = trace_close(&tracer);
+        printf("trace: %llu events logged, %llu dropped%s\n", (unsigned long long) tracer.written,
+               (unsigned long long) tracer.dropped, written ? "" : ", the log could not be written");
+    }
+    ptstat_destroy(&session.ptstat);
+    tlb_destroy(&session.tlb);
+    if (mmReady) {
+        mm_destroy(&session.mm);
+    }
+    free(trace);
+    free(image.physical_memory);
+    return status;
 }
-
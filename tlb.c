@@ -0,0 +1,193 @@
+#include "tlb.h"
+#include "memsim.h"
+#include "ptstat.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// marks an empty translation cache or prefetch buffer slot
+#define NO_PAGE UINT_MAX
+
+static const char* PREFETCHER_NAMES[TLB_PREFETCHERS] = {"none", "sequential", "stride", "distance"};
+
+static int find_page(const unsigned int* pages, unsigned int count, unsigned int page){
+    for (unsigned int i = 0; i < count; ++i) {
+        if (pages[i] == page){
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+// put a page in the least recently used slot
+static void fill(struct translation_cache* tlb, unsigned int page){
+    unsigned int victim = 0;
+    for (unsigned int i = 1; i < tlb->entries; ++i) {
+        if (tlb->last_used[i] < tlb->last_used[victim]){
+            victim = i;
+        }
+    }
+    tlb->pages[victim] = page;
+    tlb->last_used[victim] = tlb->accesses;
+}
+
+// walk the page table on behalf of the prefetcher and keep the translation if the page is present
+static void prefetch(struct translation_cache* tlb, long long page){
+    if (page < 0 || page >= tlb->num_pages
+        || find_page(tlb->pages, tlb->entries, page) >= 0
+        || find_page(tlb->buffer, tlb->buffer_entries, page) >= 0){
+        return;
+    }
+    ++tlb->prefetch_walks;
+    if (tlb->ptstat != NULL){
+        ptstat_walk(tlb->ptstat, page);
+    }
+    if (tlb->physical_memory[tlb->page_table_loc + page] & PTE_PRESENT){
+        tlb->buffer[tlb->buffer_next] = page;
+        tlb->buffer_next = (tlb->buffer_next + 1) % tlb->buffer_entries;
+        ++tlb->prefetches;
+    }
+}
+
+static void prefetch_stride(struct translation_cache* tlb, unsigned int page){
+    unsigned int region = page >> TLB_STRIDE_REGION_BITS;
+    struct tlb_stream* stream = &tlb->streams[region % TLB_STRIDE_STREAMS];
+    if (stream->region != region){
+        *stream = (struct tlb_stream){ .region = region, .last_page = page };
+        return;
+    }
+    int stride = (int) (page - stream->last_page);
+    if (stride != 0 && stride == stream->stride){
+        ++stream->confidence;
+    }else{
+        stream->stride = stride;
+        stream->confidence = 0;
+    }
+    stream->last_page = page;
+    if (stream->confidence > 0){
+        prefetch(tlb, (long long) page + stride);
+    }
+}
+
+static struct tlb_distance* distance_entry(struct translation_cache* tlb, int distance){
+    return &tlb->distances[(unsigned int) distance % TLB_DISTANCE_ENTRIES];
+}
+
+static void prefetch_distance(struct translation_cache* tlb, unsigned int page){
+    int distance = (int) (page - tlb->last_miss);
+    // remember that this distance followed the previous one
+    struct tlb_distance* previous = distance_entry(tlb, tlb->last_distance);
+    if (!previous->valid || previous->distance != tlb->last_distance){
+        *previous = (struct tlb_distance){ .valid = true, .distance = tlb->last_distance, .next = {distance, distance} };
+    }else if (previous->next[0] != distance){
+        previous->next[1] = previous->next[0];
+        previous->next[0] = distance;
+    }
+    // and prefetch what followed this distance before
+    struct tlb_distance* current = distance_entry(tlb, distance);
+    if (current->valid && current->distance == distance){
+        prefetch(tlb, (long long) page + current->next[0]);
+        prefetch(tlb, (long long) page + current->next[1]);
+    }
+    tlb->last_distance = distance;
+}
+
+bool tlb_init(struct translation_cache* tlb,
+              unsigned int entries,
+              unsigned int buffer_entries,
+              enum tlb_prefetcher prefetcher,
+              const int* physical_memory,
+              unsigned int page_table_loc,
+              unsigned int num_pages){
+    *tlb = (struct translation_cache){
+        .entries = entries,
+        .buffer_entries = buffer_entries,
+        .prefetcher = prefetcher,
+        .physical_memory = physical_memory,
+        .page_table_loc = page_table_loc,
+        .num_pages = num_pages,
+    };
+    if (entries == 0 || buffer_entries == 0){
+        return false;
+    }
+    tlb->pages = malloc(entries * sizeof(unsigned int));
+    tlb->last_used = calloc(entries, sizeof(unsigned long long));
+    tlb->buffer = malloc(buffer_entries * sizeof(unsigned int));
+    if (tlb->pages == NULL || tlb->last_used == NULL || tlb->buffer == NULL){
+        tlb_destroy(tlb);
+        return false;
+    }
+    memset(tlb->pages, 0xff, entries * sizeof(unsigned int));
+    memset(tlb->buffer, 0xff, buffer_entries * sizeof(unsigned int));
+    for (unsigned int i = 0; i < TLB_STRIDE_STREAMS; ++i) {
+        tlb->streams[i].region = NO_PAGE;
+    }
+    return true;
+}
+
+void tlb_destroy(struct translation_cache* tlb){
+    free(tlb->pages);
+    free(tlb->last_used);
+    free(tlb->buffer);
+    tlb->pages = tlb->buffer = NULL;
+    tlb->last_used = NULL;
+}
+
+bool tlb_access(struct translation_cache* tlb, unsigned int page){
+    ++tlb->accesses;
+    int slot = find_page(tlb->pages, tlb->entries, page);
+    if (slot >= 0){
+        ++tlb->hits;
+        tlb->last_used[slot] = tlb->accesses;
+        return true;
+    }
+    ++tlb->misses;
+    int buffered = find_page(tlb->buffer, tlb->buffer_entries, page);
+    if (buffered >= 0){
+        ++tlb->buffer_hits;
+        tlb->buffer[buffered] = NO_PAGE;
+    }else{
+        ++tlb->demand_walks;
+        if (tlb->ptstat != NULL){
+            ptstat_walk(tlb->ptstat, page);
+        }
+    }
+    fill(tlb, page);
+    // the prefetchers train on the miss stream
+    switch (tlb->prefetcher) {
+        case TLB_PREFETCH_SEQUENTIAL:
+            prefetch(tlb, (long long) page + 1);
+            break;
+        case TLB_PREFETCH_STRIDE:
+            prefetch_stride(tlb, page);
+            break;
+        case TLB_PREFETCH_DISTANCE:
+            prefetch_distance(tlb, page);
+            break;
+        default:
+            break;
+    }
+    tlb->last_miss = page;
+    return false;
+}
+
+void tlb_invalidate(struct translation_cache* tlb, unsigned int page){
+    int slot = find_page(tlb->pages, tlb->entries, page);
+    if (slot >= 0){
+        tlb->pages[slot] = NO_PAGE;
+        tlb->last_used[slot] = 0;
+    }
+    int buffered = find_page(tlb->buffer, tlb->buffer_entries, page);
+    if (buffered >= 0){
+        tlb->buffer[buffered] = NO_PAGE;
+    }
+}
+
+enum tlb_prefetcher tlb_prefetcher_from_name(const char* name){
+    enum tlb_prefetcher kind = TLB_PREFETCH_NONE;
+    while (kind < TLB_PREFETCHERS && strcmp(name, PREFETCHER_NAMES[kind]) != 0){
+        ++kind;
+    }
+    return kind;
+}
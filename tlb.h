@@ -0,0 +1,83 @@
+#ifndef CHALLENGE6_TLB_H
+#define CHALLENGE6_TLB_H
+#include <stdbool.h>
+
+struct ptstat;
+
+// Entries in the per-stream stride table and in the distance table.
+#define TLB_STRIDE_STREAMS 16
+#define TLB_DISTANCE_ENTRIES 64
+// Pages per stream for the stride prefetcher; accesses in the same region are taken to belong to the same stream.
+#define TLB_STRIDE_REGION_BITS 4
+
+enum tlb_prefetcher {
+    TLB_PREFETCH_NONE,
+    TLB_PREFETCH_SEQUENTIAL, // the next page after every miss
+    TLB_PREFETCH_STRIDE,     // the next page of a stream once its stride repeats
+    TLB_PREFETCH_DISTANCE,   // the pages that followed the last miss distance the previous times it was seen
+    TLB_PREFETCHERS
+};
+
+struct tlb_stream {
+    unsigned int region;
+    unsigned int last_page;
+    int stride;
+    unsigned int confidence;
+};
+
+struct tlb_distance {
+    bool valid;
+    int distance;
+    int next[2]; // most recent distance first
+};
+
+// Model of a fully associative LRU translation cache with a FIFO prefetch buffer next to it. It is told about every
+// successful translation and counts what would have hit, what would have needed a page walk and what the prefetcher
+// walked in advance. Prefetches only go into the buffer, and only for present pages.
+struct translation_cache {
+    unsigned int entries;
+    unsigned int* pages;
+    unsigned long long* last_used;
+    unsigned int buffer_entries;
+    unsigned int* buffer;
+    unsigned int buffer_next;
+    enum tlb_prefetcher prefetcher;
+    struct tlb_stream streams[TLB_STRIDE_STREAMS];
+    struct tlb_distance distances[TLB_DISTANCE_ENTRIES];
+    unsigned int last_miss;
+    int last_distance;
+    const int* physical_memory;
+    unsigned int page_table_loc;
+    unsigned int num_pages;
+    unsigned long long accesses;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long buffer_hits;    // misses served by the prefetch buffer instead of a walk
+    unsigned long long demand_walks;
+    unsigned long long prefetch_walks; // walks done by the prefetcher, present or not
+    unsigned long long prefetches;     // pages put into the prefetch buffer
+    struct ptstat* ptstat;             // optional, told about the page of every walk, demand or prefetch
+};
+
+//Sets up a translation cache with the given number of entries and prefetch buffer entries over the page table at page_table_loc. Returns false if memory could not be allocated.
+extern bool tlb_init(struct translation_cache* tlb,
+                     unsigned int entries,
+                     unsigned int buffer_entries,
+                     enum tlb_prefetcher prefetcher,
+                     const int* physical_memory,
+                     unsigned int page_table_loc,
+                     unsigned int num_pages);
+
+//Releases the arrays held by the translation cache.
+extern void tlb_destroy(struct translation_cache* tlb);
+
+//Records a translation of the page. Returns true if it hit in the translation cache.
+extern bool tlb_access(struct translation_cache* tlb, unsigned int page);
+
+//Drops the page from the translation cache and the prefetch buffer after its page table entry changed.
+extern void tlb_invalidate(struct translation_cache* tlb, unsigned int page);
+
+//Parses a prefetcher name (none, sequential, stride, distance). Returns TLB_PREFETCHERS for an unknown name.
+extern enum tlb_prefetcher tlb_prefetcher_from_name(const char* name);
+
+#endif // CHALLENGE6_TLB_H
@@ -0,0 +1,154 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// how long the flusher sleeps after finding every ring empty
+#define IDLE_NS 1000000
+
+// tracers get ids that are never reused, so a thread can tell a ring it kept from a closed tracer apart without
+// looking at it
+static _Atomic uint64_t last_tracer_id;
+
+// the ring of the calling thread and the tracer it belongs to. libms is linked rather than loaded with dlopen, so the
+// initial exec model can reach it without a call on every event.
+static _Thread_local struct {
+    uint64_t tracer_id;
+    struct trace_ring* ring;
+} thread_log __attribute__((tls_model("initial-exec")));
+
+static uint64_t now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// write out the records a ring holds, which may wrap around its end. Returns how many.
+static uint64_t drain(struct tracer* tracer, struct trace_ring* ring){
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t count = head - tail;
+    while (tail != head){
+        uint64_t index = tail & (TRACE_RING_RECORDS - 1);
+        uint64_t run = head - tail < TRACE_RING_RECORDS - index ? head - tail : TRACE_RING_RECORDS - index;
+        fwrite(&ring->records[index], sizeof(struct trace_record), run, tracer->file);
+        tail += run;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    tracer->written += count;
+    return count;
+}
+
+static void* flush(void* argument){
+    struct tracer* tracer = argument;
+    for (;;){
+        // one more pass after trace_close() asked to stop picks up what was logged before it
+        bool running = atomic_load_explicit(&tracer->running, memory_order_acquire);
+        uint64_t moved = 0;
+        for (struct trace_ring* ring = atomic_load_explicit(&tracer->rings, memory_order_acquire); ring != NULL;
+             ring = ring->next) {
+            moved += drain(tracer, ring);
+        }
+        if (!running){
+            return NULL;
+        }
+        if (moved == 0){
+            nanosleep(&(struct timespec){ .tv_nsec = IDLE_NS }, NULL);
+        }
+    }
+}
+
+// give the calling thread a ring and put it where the flusher finds it
+static __attribute__((noinline)) struct trace_ring* attach(struct tracer* tracer){
+    struct trace_ring* ring = calloc(1, sizeof(struct trace_ring));
+    if (ring == NULL){
+        return NULL;
+    }
+    ring->thread = atomic_fetch_add_explicit(&tracer->threads, 1, memory_order_relaxed) + 1;
+    ring->countdown = tracer->period;
+    ring->next = atomic_load_explicit(&tracer->rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&tracer->rings, &ring->next, ring, memory_order_release,
+                                                  memory_order_relaxed)){
+    }
+    thread_log.tracer_id = tracer->id;
+    thread_log.ring = ring;
+    return ring;
+}
+
+bool trace_open(struct tracer* tracer, const char* path, enum trace_sampling sampling, uint32_t period){
+    *tracer = (struct tracer){
+        .id = atomic_fetch_add_explicit(&last_tracer_id, 1, memory_order_relaxed) + 1,
+        .sampling = sampling,
+        .period = period,
+    };
+    if (period == 0 || (tracer->file = fopen(path, "wb")) == NULL){
+        return false;
+    }
+    struct trace_header header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .record_size = sizeof(struct trace_record),
+        .sampling = sampling,
+        .period = period,
+    };
+    fwrite(&header, sizeof(header), 1, tracer->file);
+    tracer->start_ns = now_ns();
+    atomic_store_explicit(&tracer->running, true, memory_order_relaxed);
+    if (pthread_create(&tracer->flusher, NULL, flush, tracer) != 0){
+        fclose(tracer->file);
+        return false;
+    }
+    return true;
+}
+
+bool trace_close(struct tracer* tracer){
+    atomic_store_explicit(&tracer->running, false, memory_order_release);
+    pthread_join(tracer->flusher, NULL);
+    struct trace_ring* ring = atomic_load_explicit(&tracer->rings, memory_order_acquire);
+    while (ring != NULL){
+        struct trace_ring* next = ring->next;
+        tracer->dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        free(ring);
+        ring = next;
+    }
+    atomic_store_explicit(&tracer->rings, NULL, memory_order_relaxed);
+    bool written = !ferror(tracer->file);
+    return fclose(tracer->file) == 0 && written;
+}
+
+// put a sampled event in the ring, kept out of line so events that are not sampled cost a countdown and nothing more
+static __attribute__((noinline)) void record(const struct tracer* tracer, struct trace_ring* ring,
+                                             enum trace_type type, unsigned int detail, unsigned int address,
+                                             unsigned int value){
+    ring->countdown = tracer->period;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == TRACE_RING_RECORDS){
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring->records[head & (TRACE_RING_RECORDS - 1)] = (struct trace_record){
+        .time_ns = now_ns() - tracer->start_ns,
+        .thread = ring->thread,
+        .type = type,
+        .detail = detail,
+        .address = address,
+        .value = value,
+    };
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_event(struct tracer* tracer, enum trace_type type, unsigned int detail, unsigned int address,
+                 unsigned int value){
+    if (tracer->sampling == TRACE_SAMPLE_SLOW_PATH && type == TRACE_TRANSLATE && detail == 0){
+        return;
+    }
+    struct trace_ring* ring = thread_log.tracer_id == tracer->id ? thread_log.ring : attach(tracer);
+    if (ring != NULL && --ring->countdown == 0){
+        record(tracer, ring, type, detail, address, value);
+    }
+}
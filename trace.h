@@ -0,0 +1,86 @@
+#ifndef CHALLENGE6_TRACE_H
+#define CHALLENGE6_TRACE_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Binary event log: a header followed by records, both in host byte order. Records of one thread are in the order
+// they happened; records of different threads are interleaved in the order they were flushed.
+#define TRACE_MAGIC "MSTRACE"
+#define TRACE_VERSION 1
+// Records each thread can hold before the flusher gets to them, a power of two. Events that find the ring full are
+// dropped and counted.
+#define TRACE_RING_RECORDS 32768
+
+enum trace_type {
+    TRACE_TRANSLATE, // address: virtual address, value: physical address, detail: 1 when it went through the slow path
+    TRACE_FAULT,     // address: virtual address, value: physical address when it succeeded, detail: enum mm_fault
+    TRACE_EVICT,     // address: page, value: handle in the compressed tier
+    TRACE_WRITEBACK, // a dirty page written out as it was evicted, address: page, value: handle
+    TRACE_TYPES
+};
+
+enum trace_sampling {
+    TRACE_SAMPLE_ALL,       // every period-th event
+    TRACE_SAMPLE_SLOW_PATH  // every period-th event that is not a translation done from the page table entry alone
+};
+
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t sampling;   // enum trace_sampling
+    uint32_t period;
+};
+
+struct trace_record {
+    uint64_t time_ns;    // since the log was opened
+    uint32_t thread;     // numbered from 1 in the order threads first logged an event
+    uint8_t type;        // enum trace_type
+    uint8_t detail;
+    uint16_t reserved;
+    uint32_t address;
+    uint32_t value;
+};
+
+// Ring of one thread. Only that thread moves head and only the flusher moves tail, so neither needs a lock.
+struct trace_ring {
+    struct trace_record records[TRACE_RING_RECORDS];
+    // the producer's side and the flusher's side on lines of their own
+    _Alignas(64) _Atomic uint64_t head;
+    _Atomic uint64_t dropped;
+    uint32_t thread;
+    uint32_t countdown;           // events left until the next one is sampled
+    struct trace_ring* next;
+    _Alignas(64) _Atomic uint64_t tail;
+};
+
+// Event log shared by every thread. Events go into the ring of the thread that raised them and a background thread
+// moves them from the rings to the file.
+struct tracer {
+    uint64_t id;                  // tells a thread whether its ring belongs to this tracer
+    FILE* file;
+    enum trace_sampling sampling;
+    uint32_t period;
+    uint64_t start_ns;
+    _Atomic(struct trace_ring*) rings;
+    _Atomic uint32_t threads;
+    atomic_bool running;
+    pthread_t flusher;
+    uint64_t written;             // records in the file, kept by the flusher
+    uint64_t dropped;             // set by trace_close()
+};
+
+//Opens the log at path and starts the flusher. One in period events of the kind sampling selects is recorded. Returns false if period is 0, the file could not be created or the thread could not be started.
+extern bool trace_open(struct tracer* tracer, const char* path, enum trace_sampling sampling, uint32_t period);
+
+//Stops the flusher once every ring is empty, closes the file and releases the rings. No thread may log to the tracer any more. Returns false if writing the log failed.
+extern bool trace_close(struct tracer* tracer);
+
+//Logs an event from the calling thread if sampling picks it. Never blocks.
+extern void trace_event(struct tracer* tracer, enum trace_type type, unsigned int detail, unsigned int address,
+                        unsigned int value);
+
+#endif // CHALLENGE6_TRACE_H
@@ -0,0 +1,76 @@
+// Converts an event log written by memorysimulator -T into the Chrome trace event format, which chrome://tracing and
+// Perfetto open. Every record becomes an instant event on the track of the thread that logged it.
+
+#include <stdio.h>
+#include <string.h>
+#include "mm.h"
+#include "trace.h"
+
+static const char* EVENT_NAMES[TRACE_TYPES] = {"translate", "fault", "evict", "writeback"};
+static const char* FAULT_NAMES[MM_FAULT_TYPES] = {"none", "lazy", "copy-on-write", "swap-in", "protection",
+                                                  "segmentation", "out of memory"};
+
+static void write_event(FILE* out, const struct trace_record* record, bool first){
+    // timestamps are in microseconds
+    fprintf(out, "%s{\"name\":\"%s", first ? "" : ",\n", EVENT_NAMES[record->type]);
+    if (record->type == TRACE_FAULT){
+        fprintf(out, " (%s)", record->detail < MM_FAULT_TYPES ? FAULT_NAMES[record->detail] : "unknown");
+    }
+    fprintf(out, "\",\"cat\":\"memsim\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{",
+            record->time_ns / 1000.0, record->thread);
+    if (record->type == TRACE_TRANSLATE){
+        fprintf(out, "\"virtual\":%u,\"physical\":%u,\"slow_path\":%s}}", record->address, record->value,
+                record->detail ? "true" : "false");
+    }else if (record->type == TRACE_FAULT){
+        fprintf(out, "\"virtual\":%u,\"physical\":%u}}", record->address, record->value);
+    }else{
+        fprintf(out, "\"page\":%u,\"handle\":%u}}", record->address, record->value);
+    }
+}
+
+int main(const int argc, const char** argv){
+    const char* USAGE = "Usage: %s <log> [out.json]\n";
+    if (argc < 2 || argc > 3){
+        printf(USAGE, argv[0]);
+        return -1;
+    }
+    FILE* in = fopen(argv[1], "rb");
+    if (in == NULL){
+        printf("%s could not be opened\n", argv[1]);
+        return -1;
+    }
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0
+        || header.version != TRACE_VERSION || header.record_size != sizeof(struct trace_record)){
+        printf("%s is not an event log this version can read\n", argv[1]);
+        fclose(in);
+        return -1;
+    }
+    FILE* out = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if (out == NULL){
+        printf("%s could not be opened\n", argv[2]);
+        fclose(in);
+        return -1;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"sampling\":\"%s\",\"period\":%u},\"traceEvents\":[\n",
+            header.sampling == TRACE_SAMPLE_SLOW_PATH ? "slow path" : "all", header.period);
+    unsigned long long events = 0, skipped = 0;
+    struct trace_record records[4096];
+    for (size_t count; (count = fread(records, sizeof(struct trace_record), 4096, in)) > 0;) {
+        for (size_t i = 0; i < count; ++i) {
+            if (records[i].type >= TRACE_TYPES){
+                ++skipped;
+                continue;
+            }
+            write_event(out, &records[i], events++ == 0);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(in);
+    if (out != stdout){
+        fclose(out);
+    }
+    fprintf(stderr, "%llu events, %llu records of unknown type skipped\n", events, skipped);
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include "vma.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+static int height(const struct vma* node){
+    return node == NULL ? 0 : node->height;
+}
+
+static void update_height(struct vma* node){
+    int l = height(node->left), r = height(node->right);
+    node->height = (l > r ? l : r) + 1;
+}
+
+static struct vma* rotate_right(struct vma* node){
+    struct vma* pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static struct vma* rotate_left(struct vma* node){
+    struct vma* pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static struct vma* rebalance(struct vma* node){
+    update_height(node);
+    int balance = height(node->left) - height(node->right);
+    if (balance > 1){
+        if (height(node->left->left) < height(node->left->right)){
+            node->left = rotate_left(node->left);
+        }
+        return rotate_right(node);
+    }
+    if (balance < -1){
+        if (height(node->right->right) < height(node->right->left)){
+            node->right = rotate_right(node->right);
+        }
+        return rotate_left(node);
+    }
+    return node;
+}
+
+static struct vma* insert_node(struct vma* root, struct vma* node){
+    if (root == NULL){
+        return node;
+    }
+    if (node->start < root->start){
+        root->left = insert_node(root->left, node);
+    }else{
+        root->right = insert_node(root->right, node);
+    }
+    return rebalance(root);
+}
+
+// unlink the leftmost node of a subtree and hand it back through min
+static struct vma* remove_min(struct vma* root, struct vma** min){
+    if (root->left == NULL){
+        *min = root;
+        return root->right;
+    }
+    root->left = remove_min(root->left, min);
+    return rebalance(root);
+}
+
+// remove and free the node with the given start
+static struct vma* remove_node(struct vma* root, unsigned int start){
+    if (root == NULL){
+        return NULL;
+    }
+    if (start < root->start){
+        root->left = remove_node(root->left, start);
+    }else if (start > root->start){
+        root->right = remove_node(root->right, start);
+    }else{
+        struct vma *left = root->left, *right = root->right, *successor;
+        free(root);
+        if (right == NULL){
+            return left;
+        }
+        right = remove_min(right, &successor);
+        successor->left = left;
+        successor->right = right;
+        root = successor;
+    }
+    return rebalance(root);
+}
+
+struct vma* vma_find(const struct vma_tree* tree, unsigned int address){
+    struct vma* node = tree->root;
+    while (node != NULL){
+        if (address < node->start){
+            node = node->left;
+        }else if (address >= node->end){
+            node = node->right;
+        }else{
+            return node;
+        }
+    }
+    return NULL;
+}
+
+struct vma* vma_first_overlap(const struct vma_tree* tree, unsigned int start, unsigned int end){
+    // areas are disjoint, so their ends are ordered like their starts: look for the lowest end above start
+    struct vma *node = tree->root, *found = NULL;
+    while (node != NULL){
+        if (node->end > start){
+            found = node;
+            node = node->left;
+        }else{
+            node = node->right;
+        }
+    }
+    return (found != NULL && found->start < end) ? found : NULL;
+}
+
+struct vma* vma_last(const struct vma_tree* tree){
+    struct vma* node = tree->root;
+    while (node != NULL && node->right != NULL){
+        node = node->right;
+    }
+    return node;
+}
+
+bool vma_insert(struct vma_tree* tree, unsigned int start, unsigned int end, unsigned int prot){
+    struct vma* node = malloc(sizeof(struct vma));
+    if (node == NULL){
+        return false;
+    }
+    *node = (struct vma){ .start = start, .end = end, .prot = prot, .height = 1 };
+    tree->root = insert_node(tree->root, node);
+    ++tree->count;
+    return true;
+}
+
+bool vma_remove_range(struct vma_tree* tree, unsigned int start, unsigned int end){
+    struct vma* area;
+    while ((area = vma_first_overlap(tree, start, end)) != NULL){
+        unsigned int a_start = area->start, a_end = area->end, prot = area->prot;
+        tree->root = remove_node(tree->root, a_start);
+        --tree->count;
+        // put back whatever sticks out on either side
+        if (a_start < start && !vma_insert(tree, a_start, start, prot)){
+            return false;
+        }
+        if (a_end > end && !vma_insert(tree, end, a_end, prot)){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool vma_protect_range(struct vma_tree* tree, unsigned int start, unsigned int end, unsigned int prot){
+    // check for holes first so a failed call changes nothing
+    for (unsigned int pos = start; pos < end;) {
+        struct vma* area = vma_find(tree, pos);
+        if (area == NULL){
+            return false;
+        }
+        pos = area->end;
+    }
+    for (unsigned int pos = start; pos < end;) {
+        struct vma* area = vma_find(tree, pos);
+        unsigned int a_start = area->start, a_end = area->end, a_prot = area->prot;
+        unsigned int piece_end = a_end < end ? a_end : end;
+        if (a_prot == prot){
+            pos = piece_end;
+            continue;
+        }
+        tree->root = remove_node(tree->root, a_start);
+        --tree->count;
+        if ((a_start < pos && !vma_insert(tree, a_start, pos, a_prot))
+            || !vma_insert(tree, pos, piece_end, prot)
+            || (a_end > piece_end && !vma_insert(tree, piece_end, a_end, a_prot))){
+            return false;
+        }
+        pos = piece_end;
+    }
+    return true;
+}
+
+static void destroy_nodes(struct vma* node){
+    if (node == NULL){
+        return;
+    }
+    destroy_nodes(node->left);
+    destroy_nodes(node->right);
+    free(node);
+}
+
+void vma_destroy(struct vma_tree* tree){
+    destroy_nodes(tree->root);
+    tree->root = NULL;
+    tree->count = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef CHALLENGE6_VMA_H
+#define CHALLENGE6_VMA_H
+#include <stdbool.h>
+
+// Protection bits of a virtual memory area, also used as the access type of a translation.
+#define VMA_READ 1
+#define VMA_WRITE 2
+
+// A mapped range [start, end) of virtual words. Areas never overlap, so the tree is an AVL tree ordered by start and a
+// lookup finds the area with the greatest start not above the address.
+struct vma {
+    unsigned int start;
+    unsigned int end;
+    unsigned int prot;
+    int height;
+    struct vma* left;
+    struct vma* right;
+};
+
+struct vma_tree {
+    struct vma* root;
+    unsigned int count;
+};
+
+//Returns the area containing the address, or NULL if the address is not mapped.
+extern struct vma* vma_find(const struct vma_tree* tree, unsigned int address);
+
+//Returns the lowest area overlapping [start, end), or NULL if the range is not mapped at all.
+extern struct vma* vma_first_overlap(const struct vma_tree* tree, unsigned int start, unsigned int end);
+
+//Returns the area with the highest start, or NULL if the tree is empty.
+extern struct vma* vma_last(const struct vma_tree* tree);
+
+//Adds the area [start, end) with the given protection. The range must not overlap an existing area. Returns false if the node could not be allocated.
+extern bool vma_insert(struct vma_tree* tree, unsigned int start, unsigned int end, unsigned int prot);
+
+//Unmaps [start, end), splitting areas that are only partly covered. Returns false if a split could not be allocated.
+extern bool vma_remove_range(struct vma_tree* tree, unsigned int start, unsigned int end);
+
+//Changes the protection of [start, end), splitting areas that are only partly covered. The whole range has to be mapped. Returns false otherwise.
+extern bool vma_protect_range(struct vma_tree* tree, unsigned int start, unsigned int end, unsigned int prot);
+
+//Frees every area in the tree.
+extern void vma_destroy(struct vma_tree* tree);
+
+#endif // CHALLENGE6_VMA_H
@@ -0,0 +1,89 @@
+#include "wss.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void write_row(const struct wss* wss){
+    fprintf(wss->series, "%llu", wss->time);
+    for (unsigned int k = 0; k < wss->windows; ++k) {
+        fprintf(wss->series, ",%u", wss->size[k]);
+    }
+    fputc('\n', wss->series);
+}
+
+bool wss_init(struct wss* wss,
+              unsigned int num_pages,
+              const unsigned long long* windows,
+              unsigned int window_count,
+              FILE* series,
+              unsigned long long interval){
+    *wss = (struct wss){ .num_pages = num_pages, .windows = window_count, .series = series, .interval = interval };
+    if (window_count == 0 || window_count > WSS_MAX_WINDOWS || (series != NULL && interval == 0)){
+        return false;
+    }
+    // the ring has to reach back as far as the largest window
+    unsigned long long ring = 1;
+    for (unsigned int k = 0; k < window_count; ++k) {
+        if (windows[k] == 0 || windows[k] > WSS_MAX_WINDOW){
+            return false;
+        }
+        wss->window[k] = windows[k];
+        while (ring < windows[k]){
+            ring *= 2;
+        }
+    }
+    wss->ring_mask = ring - 1;
+    wss->last_access = calloc(num_pages, sizeof(unsigned long long));
+    wss->recent = malloc(ring * sizeof(unsigned int));
+    if (wss->last_access == NULL || wss->recent == NULL){
+        wss_destroy(wss);
+        return false;
+    }
+    if (series != NULL){
+        fprintf(series, "accesses");
+        for (unsigned int k = 0; k < window_count; ++k) {
+            fprintf(series, ",ws_%llu", windows[k]);
+        }
+        fputc('\n', series);
+    }
+    return true;
+}
+
+void wss_destroy(struct wss* wss){
+    free(wss->last_access);
+    free(wss->recent);
+    wss->last_access = NULL;
+    wss->recent = NULL;
+}
+
+void wss_access(struct wss* wss, unsigned int page){
+    unsigned long long now = ++wss->time, last = wss->last_access[page];
+    for (unsigned int k = 0; k < wss->windows; ++k) {
+        // the access that just fell out of the window takes its page along unless the page was accessed since
+        unsigned long long window = wss->window[k];
+        if (now > window){
+            unsigned long long leaving = now - window;
+            wss->size[k] -= wss->last_access[wss->recent[leaving & wss->ring_mask]] == leaving;
+        }
+        // counted from here on if this access brings it back into the window
+        wss->size[k] += last == 0 || now - last >= window;
+    }
+    wss->touched += last == 0;
+    wss->last_access[page] = now;
+    wss->recent[now & wss->ring_mask] = page;
+    if (wss->series != NULL && now % wss->interval == 0){
+        write_row(wss);
+    }
+}
+
+unsigned int wss_idle_ages(const struct wss* wss, unsigned int histogram[WSS_AGE_BUCKETS]){
+    memset(histogram, 0, WSS_AGE_BUCKETS * sizeof(unsigned int));
+    for (unsigned int page = 0; page < wss->num_pages; ++page) {
+        if (wss->last_access[page] != 0){
+            unsigned long long age = wss->time - wss->last_access[page];
+            ++histogram[age == 0 ? 0 : 64 - __builtin_clzll(age)];
+        }
+    }
+    return wss->num_pages - wss->touched;
+}
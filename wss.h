@@ -0,0 +1,48 @@
+#ifndef CHALLENGE6_WSS_H
+#define CHALLENGE6_WSS_H
+#include <stdbool.h>
+#include <stdio.h>
+
+// Most window sizes followed at once, and the largest window in accesses.
+#define WSS_MAX_WINDOWS 8
+#define WSS_MAX_WINDOW (1ull << 28)
+// Idle ages are counted in power-of-two buckets: bucket 0 holds age 0 and bucket k the ages from 2^(k-1) up to
+// 2^k - 1.
+#define WSS_AGE_BUCKETS 65
+
+// Working set tracker. Time counts accesses, and WS(t, window) is the number of pages accessed in the last window
+// accesses. Every window keeps its count up to date as pages enter and leave it: a page enters when it is accessed
+// after being out of the window, and leaves window accesses after its last access, which is found in a ring holding
+// the page of every recent access. Both take constant time per window.
+struct wss {
+    unsigned int num_pages;
+    unsigned long long* last_access; // time of the last access to each page, 0 before the first
+    unsigned int windows;
+    unsigned long long window[WSS_MAX_WINDOWS];
+    unsigned int size[WSS_MAX_WINDOWS];
+    unsigned int* recent;            // page of the access at each time, modulo the ring size
+    unsigned long long ring_mask;
+    unsigned long long time;
+    unsigned int touched;            // pages accessed at least once
+    FILE* series;                    // optional, gets a CSV row with every window size each interval accesses
+    unsigned long long interval;
+};
+
+//Sets up a tracker for num_pages pages following the given window sizes, each from 1 to WSS_MAX_WINDOW. With series set a CSV header is written to it and a row every interval accesses. Returns false for a bad window count or size, or if memory could not be allocated.
+extern bool wss_init(struct wss* wss,
+                     unsigned int num_pages,
+                     const unsigned long long* windows,
+                     unsigned int window_count,
+                     FILE* series,
+                     unsigned long long interval);
+
+//Releases the arrays held by the tracker. The series file belongs to the caller.
+extern void wss_destroy(struct wss* wss);
+
+//Records an access to the page.
+extern void wss_access(struct wss* wss, unsigned int page);
+
+//Counts the pages accessed at least once by the time since their last access, in the buckets described at WSS_AGE_BUCKETS. Returns the number of pages never accessed.
+extern unsigned int wss_idle_ages(const struct wss* wss, unsigned int histogram[WSS_AGE_BUCKETS]);
+
+#endif // CHALLENGE6_WSS_H
@@ -0,0 +1,357 @@
+#include "zswap.h"
+#include "memsim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// LZ4 block format: a token with the literal count in the high nibble and the match length minus MIN_MATCH in the
+// low one, longer counts continued in bytes of 255, the literals, and a two byte offset back to the match. The last
+// sequence has literals only.
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define HASH_BITS 12
+
+static unsigned long long now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static uint32_t read32(const unsigned char* p){
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// write a count that did not fit in its nibble, false if it runs past the end
+static bool put_length(unsigned char** out, const unsigned char* end, unsigned int length){
+    for (; length >= 255; length -= 255) {
+        if (*out >= end){
+            return false;
+        }
+        *(*out)++ = 255;
+    }
+    if (*out >= end){
+        return false;
+    }
+    *(*out)++ = (unsigned char) length;
+    return true;
+}
+
+static bool put_sequence(unsigned char** out, const unsigned char* end, const unsigned char* literals,
+                         unsigned int literal_count, unsigned int offset, unsigned int match_length){
+    if (*out >= end){
+        return false;
+    }
+    unsigned int match_code = match_length == 0 ? 0 : match_length - MIN_MATCH;
+    *(*out)++ = (unsigned char) ((literal_count < 15 ? literal_count : 15) << 4 | (match_code < 15 ? match_code : 15));
+    if ((literal_count >= 15 && !put_length(out, end, literal_count - 15)) || (size_t) (end - *out) < literal_count){
+        return false;
+    }
+    memcpy(*out, literals, literal_count);
+    *out += literal_count;
+    if (match_length == 0){
+        return true;
+    }
+    if (end - *out < 2){
+        return false;
+    }
+    *(*out)++ = (unsigned char) offset;
+    *(*out)++ = (unsigned char) (offset >> 8);
+    return match_code < 15 || put_length(out, end, match_code - 15);
+}
+
+unsigned int zswap_compress(const unsigned char* source, unsigned int count, unsigned char* destination,
+                            unsigned int capacity){
+    // position + 1 of the last four bytes with each hash, sized to the input so small frames do not clear it all
+    uint32_t table[1 << HASH_BITS];
+    unsigned int bits = 4;
+    while (bits < HASH_BITS && (1u << bits) < count){
+        ++bits;
+    }
+    memset(table, 0, (sizeof(uint32_t)) << bits);
+    unsigned char* out = destination;
+    const unsigned char* end = destination + capacity;
+    unsigned int anchor = 0;
+    for (unsigned int at = 0; at + MIN_MATCH <= count;) {
+        uint32_t sequence = read32(source + at);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - bits);
+        unsigned int candidate = table[hash];
+        table[hash] = at + 1;
+        if (candidate == 0 || at - (candidate - 1) > MAX_OFFSET || read32(source + candidate - 1) != sequence){
+            ++at;
+            continue;
+        }
+        unsigned int match = candidate - 1, length = MIN_MATCH;
+        while (at + length < count && source[match + length] == source[at + length]){
+            ++length;
+        }
+        if (!put_sequence(&out, end, source + anchor, at - anchor, at - match, length)){
+            return 0;
+        }
+        at += length;
+        anchor = at;
+    }
+    if (!put_sequence(&out, end, source + anchor, count - anchor, 0, 0)){
+        return 0;
+    }
+    return out - destination;
+}
+
+static unsigned int get_length(const unsigned char** in, unsigned int length){
+    if (length == 15){
+        unsigned char more;
+        do {
+            more = *(*in)++;
+            length += more;
+        } while (more == 255);
+    }
+    return length;
+}
+
+void zswap_decompress(const unsigned char* source, unsigned int length, unsigned char* destination,
+                      unsigned int count){
+    const unsigned char* in = source;
+    const unsigned char* end = source + length;
+    unsigned char* out = destination;
+    while (in < end){
+        unsigned char token = *in++;
+        unsigned int literals = get_length(&in, token >> 4);
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+        if (in >= end){
+            break;
+        }
+        unsigned int offset = in[0] | in[1] << 8;
+        in += 2;
+        unsigned int match = get_length(&in, token & 15) + MIN_MATCH;
+        // byte by byte, the match may overlap what it is copying
+        for (const unsigned char* from = out - offset; match > 0 && out < destination + count; --match) {
+            *out++ = *from++;
+        }
+    }
+}
+
+static unsigned char* slot_data(const struct zswap* zswap, const struct zswap_entry* entry){
+    const struct zswap_pool_frame* record = &zswap->pool[entry->where];
+    return (unsigned char*) &zswap->mm->physical_memory[record->frame * zswap->mm->frame_words]
+           + entry->slot * record->slot_bytes;
+}
+
+static bool grow(void** array, unsigned int* capacity, size_t size){
+    unsigned int grown = *capacity == 0 ? 64 : *capacity * 2;
+    void* resized = realloc(*array, grown * size);
+    if (resized == NULL){
+        return false;
+    }
+    *array = resized;
+    *capacity = grown;
+    return true;
+}
+
+static bool new_entry(struct zswap* zswap, unsigned int* handle){
+    if (zswap->free_entry == 0){
+        unsigned int old = zswap->entry_capacity;
+        if (old == PTE_MAX_WORDS || !grow((void**) &zswap->entries, &zswap->entry_capacity,
+                                          sizeof(struct zswap_entry))){
+            return false;
+        }
+        for (unsigned int i = zswap->entry_capacity; i > old; --i) {
+            zswap->entries[i - 1].where = zswap->free_entry;
+            zswap->free_entry = i;
+        }
+    }
+    *handle = zswap->free_entry - 1;
+    zswap->free_entry = zswap->entries[*handle].where;
+    return true;
+}
+
+// a slot of the class that fits length bytes, taking a new pool frame when the class has no free slot
+static bool pool_slot(struct zswap* zswap, unsigned int length, unsigned int* where, unsigned int* slot){
+    unsigned int class = (length + zswap->unit - 1) / zswap->unit;
+    unsigned int slot_bytes = class * zswap->unit, slots = zswap->frame_bytes / slot_bytes;
+    if (zswap->partial[class] == 0){
+        if (zswap->pool_frames >= zswap->max_pool_frames){
+            ++zswap->pool_full;
+            return false;
+        }
+        if (zswap->free_pool == 0){
+            unsigned int old = zswap->pool_capacity;
+            if (!grow((void**) &zswap->pool, &zswap->pool_capacity, sizeof(struct zswap_pool_frame))){
+                return false;
+            }
+            for (unsigned int i = zswap->pool_capacity; i > old; --i) {
+                zswap->pool[i - 1].next = zswap->free_pool;
+                zswap->free_pool = i;
+            }
+        }
+        int frame = buddy_alloc(&zswap->mm->frames, 0);
+        if (frame < 0){
+            return false;
+        }
+        mm_pin_frame(zswap->mm, (unsigned int) frame);
+        unsigned int index = zswap->free_pool - 1;
+        zswap->free_pool = zswap->pool[index].next;
+        zswap->pool[index] = (struct zswap_pool_frame){ .frame = (unsigned int) frame, .slot_bytes = slot_bytes,
+                                                        .next = 0, .listed = true };
+        zswap->partial[class] = index + 1;
+        ++zswap->pool_frames;
+    }
+    *where = zswap->partial[class] - 1;
+    struct zswap_pool_frame* record = &zswap->pool[*where];
+    *slot = __builtin_ctzll(~record->used);
+    record->used |= 1ull << *slot;
+    if (record->used == (slots == 64 ? ~0ull : (1ull << slots) - 1)){
+        // full, off the list until a slot is freed
+        zswap->partial[class] = record->next;
+        record->listed = false;
+    }
+    return true;
+}
+
+static void free_slot(struct zswap* zswap, unsigned int where, unsigned int slot){
+    struct zswap_pool_frame* record = &zswap->pool[where];
+    unsigned int class = record->slot_bytes / zswap->unit;
+    record->used &= ~(1ull << slot);
+    if (!record->listed){
+        record->next = zswap->partial[class];
+        zswap->partial[class] = where + 1;
+        record->listed = true;
+    }
+    if (record->used != 0){
+        return;
+    }
+    // the frame is empty, give it back
+    for (unsigned int* link = &zswap->partial[class]; *link != 0; link = &zswap->pool[*link - 1].next) {
+        if (*link == where + 1){
+            *link = record->next;
+            break;
+        }
+    }
+    mm_unpin_frame(zswap->mm, record->frame);
+    record->next = zswap->free_pool;
+    zswap->free_pool = where + 1;
+    --zswap->pool_frames;
+}
+
+static bool swap_slot(struct zswap* zswap, unsigned int* slot){
+    unsigned int words = zswap->mm->frame_words;
+    if (zswap->free_swap == 0){
+        unsigned int old = zswap->swap_capacity;
+        if (!grow((void**) &zswap->swap, &zswap->swap_capacity, words * sizeof(int))){
+            return false;
+        }
+        for (unsigned int i = zswap->swap_capacity; i > old; --i) {
+            zswap->swap[(i - 1) * words] = (int) zswap->free_swap;
+            zswap->free_swap = i;
+        }
+    }
+    *slot = zswap->free_swap - 1;
+    zswap->free_swap = (unsigned int) zswap->swap[*slot * words];
+    return true;
+}
+
+static void free_swap_slot(struct zswap* zswap, unsigned int slot){
+    zswap->swap[slot * zswap->mm->frame_words] = (int) zswap->free_swap;
+    zswap->free_swap = slot + 1;
+}
+
+bool zswap_init(struct zswap* zswap, struct address_space* mm, unsigned int max_pool_percent){
+    unsigned int frame_bytes = mm->frame_words * sizeof(int);
+    unsigned int unit = frame_bytes / ZSWAP_CLASSES;
+    *zswap = (struct zswap){
+        .mm = mm,
+        .frame_bytes = frame_bytes,
+        .unit = unit < sizeof(int) ? sizeof(int) : unit,
+        .max_pool_frames = (unsigned int) ((unsigned long long) mm->frames.num_frames * max_pool_percent / 100),
+    };
+    zswap->buffer = malloc(frame_bytes);
+    return zswap->buffer != NULL;
+}
+
+void zswap_destroy(struct zswap* zswap){
+    free(zswap->entries);
+    free(zswap->pool);
+    free(zswap->swap);
+    free(zswap->buffer);
+}
+
+bool zswap_store(struct zswap* zswap, const int* words, unsigned int* handle){
+    unsigned int count = zswap->mm->frame_words;
+    if (!new_entry(zswap, handle)){
+        return false;
+    }
+    struct zswap_entry* entry = &zswap->entries[*handle];
+    ++zswap->stores;
+    unsigned int same = 1;
+    while (same < count && words[same] == words[0]){
+        ++same;
+    }
+    if (same == count){
+        *entry = (struct zswap_entry){ .kind = ZSWAP_SAME_FILLED, .value = words[0] };
+        ++zswap->same_filled_pages;
+        return true;
+    }
+    // only worth a slot when two or more fit in a frame
+    unsigned long long start = now_ns();
+    unsigned int length = zswap_compress((const unsigned char*) words, zswap->frame_bytes, zswap->buffer,
+                                         zswap->frame_bytes / 2 / zswap->unit * zswap->unit);
+    zswap->compress_ns += now_ns() - start;
+    ++zswap->compressions;
+    unsigned int where, slot;
+    if (length == 0){
+        ++zswap->incompressible;
+    }else if (pool_slot(zswap, length, &where, &slot)){
+        *entry = (struct zswap_entry){ .kind = ZSWAP_POOLED, .length = length, .where = where, .slot = slot };
+        memcpy(slot_data(zswap, entry), zswap->buffer, length);
+        zswap->pooled_bytes += length;
+        ++zswap->pooled_pages;
+        return true;
+    }
+    if (!swap_slot(zswap, &slot)){
+        entry->where = zswap->free_entry;
+        zswap->free_entry = *handle + 1;
+        return false;
+    }
+    *entry = (struct zswap_entry){ .kind = ZSWAP_SWAPPED, .where = slot };
+    memcpy(&zswap->swap[slot * count], words, zswap->frame_bytes);
+    ++zswap->swapped_pages;
+    return true;
+}
+
+void zswap_load(struct zswap* zswap, unsigned int handle, int* words){
+    const struct zswap_entry* entry = &zswap->entries[handle];
+    ++zswap->loads;
+    if (entry->kind == ZSWAP_SAME_FILLED){
+        for (unsigned int i = 0; i < zswap->mm->frame_words; ++i) {
+            words[i] = entry->value;
+        }
+    }else if (entry->kind == ZSWAP_POOLED){
+        unsigned long long start = now_ns();
+        zswap_decompress(slot_data(zswap, entry), entry->length, (unsigned char*) words, zswap->frame_bytes);
+        zswap->decompress_ns += now_ns() - start;
+        ++zswap->decompressions;
+    }else{
+        memcpy(words, &zswap->swap[entry->where * zswap->mm->frame_words], zswap->frame_bytes);
+    }
+    zswap_drop(zswap, handle);
+}
+
+void zswap_drop(struct zswap* zswap, unsigned int handle){
+    struct zswap_entry* entry = &zswap->entries[handle];
+    if (entry->kind == ZSWAP_SAME_FILLED){
+        --zswap->same_filled_pages;
+    }else if (entry->kind == ZSWAP_POOLED){
+        free_slot(zswap, entry->where, entry->slot);
+        zswap->pooled_bytes -= entry->length;
+        --zswap->pooled_pages;
+    }else{
+        free_swap_slot(zswap, entry->where);
+        --zswap->swapped_pages;
+    }
+    entry->where = zswap->free_entry;
+    zswap->free_entry = handle + 1;
+}
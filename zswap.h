@@ -0,0 +1,93 @@
+#ifndef CHALLENGE6_ZSWAP_H
+#define CHALLENGE6_ZSWAP_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "mm.h"
+
+// Most size classes of the pool. A class holds slots of class * unit bytes, where the unit is the frame size divided by
+// this, but at least a word.
+#define ZSWAP_CLASSES 32
+
+enum zswap_kind {
+    ZSWAP_SAME_FILLED, // every word of the page has the same value, nothing is stored but the value
+    ZSWAP_POOLED,      // compressed into a slot of a pool frame
+    ZSWAP_SWAPPED      // did not compress or did not fit in the pool, kept whole outside physical memory
+};
+
+// An evicted page. Free entries are chained through where.
+struct zswap_entry {
+    unsigned char kind;
+    unsigned int length; // compressed bytes, for pooled pages
+    unsigned int where;  // pool frame index or swap slot
+    unsigned int slot;
+    int value;           // the value of a same filled page
+};
+
+// A frame of physical memory split into slots of one size class. Frames with a free slot are chained per class.
+struct zswap_pool_frame {
+    unsigned int frame;
+    unsigned int slot_bytes;
+    uint64_t used;       // bit per slot
+    unsigned int next;   // index + 1 of the next frame of the class with a free slot, or of the next unused record
+    bool listed;
+};
+
+// Compressed tier between the frames in use and swap. mm_access() evicts pages here when it runs out of frames and
+// brings them back on the next touch. Compressed pages are packed into frames taken from the same physical memory, so
+// a page only makes room when it compresses to half a frame or less; the rest go to a swap store outside physical
+// memory, as do all pages once the pool reaches max_pool_frames.
+struct zswap {
+    struct address_space* mm;
+    unsigned int frame_bytes;
+    unsigned int unit;
+    struct zswap_entry* entries;
+    unsigned int entry_capacity;
+    unsigned int free_entry;          // index + 1 of the first free entry
+    struct zswap_pool_frame* pool;
+    unsigned int pool_capacity;
+    unsigned int free_pool;           // index + 1 of the first unused pool record
+    unsigned int partial[ZSWAP_CLASSES + 1];
+    unsigned int max_pool_frames;
+    int* swap;                        // frame_bytes per slot
+    unsigned int swap_capacity;
+    unsigned int free_swap;           // index + 1 of the first free swap slot, chained through the slot's first word
+    unsigned char* buffer;            // compressed output, before it has a slot
+    unsigned int pool_frames;
+    unsigned int same_filled_pages;
+    unsigned int pooled_pages;
+    unsigned int swapped_pages;
+    unsigned long long pooled_bytes;  // compressed bytes held by the pool
+    unsigned long long stores;
+    unsigned long long loads;
+    unsigned long long incompressible; // pages sent to swap because they did not compress to half a frame
+    unsigned long long pool_full;      // pages sent to swap because the pool was at its limit
+    unsigned long long compressions;
+    unsigned long long compress_ns;
+    unsigned long long decompressions;
+    unsigned long long decompress_ns;
+};
+
+//Sets up the tier for an address space, letting the pool grow to max_pool_percent of the frames. Returns false if memory could not be allocated.
+extern bool zswap_init(struct zswap* zswap, struct address_space* mm, unsigned int max_pool_percent);
+
+//Releases every entry, pool frame and swap slot.
+extern void zswap_destroy(struct zswap* zswap);
+
+//Stores the frame_words words of an evicted page and sets its handle. The words are read before the pool takes a frame, so they may sit in a frame that was just given back. Returns false if memory could not be allocated.
+extern bool zswap_store(struct zswap* zswap, const int* words, unsigned int* handle);
+
+//Restores the page behind handle into words and forgets it.
+extern void zswap_load(struct zswap* zswap, unsigned int handle, int* words);
+
+//Forgets the page behind handle without restoring it.
+extern void zswap_drop(struct zswap* zswap, unsigned int handle);
+
+//Compresses count bytes LZ4 style into at most capacity bytes. Returns the compressed length, or 0 if it does not fit.
+extern unsigned int zswap_compress(const unsigned char* source, unsigned int count, unsigned char* destination,
+                                   unsigned int capacity);
+
+//Expands length bytes written by zswap_compress() into destination, which has room for count bytes.
+extern void zswap_decompress(const unsigned char* source, unsigned int length, unsigned char* destination,
+                             unsigned int count);
+
+#endif // CHALLENGE6_ZSWAP_H